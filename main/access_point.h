@@ -32,11 +32,15 @@ public:
         stop();
     }
 
-    void start(const std::string& ssid, const std::string& password) {
+    /// @param concurrent the AP is added to a running STA (APSTA), the driver is not initialized again
+    void start(const std::string& ssid, const std::string& password, bool concurrent = false) {
+        _concurrent = concurrent;
         _ap = esp_netif_create_default_wifi_ap();
 
-        wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-        ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+        if (!concurrent) {
+            wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+            ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+        }
 
         wifi_config_t wifi_config = {};
         strncpy(reinterpret_cast<char*>(wifi_config.ap.ssid), ssid.c_str(), sizeof(wifi_config.ap.ssid));
@@ -49,9 +53,12 @@ public:
             wifi_config.ap.authmode = WIFI_AUTH_OPEN;
         }
 
-        ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+        // in APSTA the AP follows the channel of the STA
+        ESP_ERROR_CHECK(esp_wifi_set_mode(concurrent ? WIFI_MODE_APSTA : WIFI_MODE_AP));
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
-        ESP_ERROR_CHECK(esp_wifi_start());
+        if (!concurrent) {
+            ESP_ERROR_CHECK(esp_wifi_start());
+        }
 
         ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                            ESP_EVENT_ANY_ID,
@@ -66,6 +73,17 @@ public:
             _instanceAnyId = nullptr;
         }
 
+        if (_concurrent) {
+            // the STA keeps the driver
+            esp_wifi_set_mode(WIFI_MODE_STA);
+            if (_ap) {
+                esp_netif_destroy(_ap);
+                _ap = nullptr;
+            }
+            _concurrent = false;
+            return;
+        }
+
         esp_wifi_stop();
         esp_wifi_deinit();
         esp_wifi_set_mode(WIFI_MODE_NULL);
@@ -113,6 +131,7 @@ private:
     static constexpr const char *TAG = "AP";
     esp_event_handler_instance_t _instanceAnyId;
     bool _coreinit;
+    bool _concurrent{false};
     esp_netif_t* _ap;
 
     // Callbacks
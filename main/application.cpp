@@ -10,6 +10,7 @@
 #include "content_file.h"
 #include "driver/uart.h"
 #include "key_val.h"
+#include "config.h"
 #include <inttypes.h>
 
 // global application instance as singleton and instance acquisition.
@@ -50,6 +51,9 @@ void Application::init()
     KeyVal &kv = KeyVal::getInstance();
     kv.init(literals::kv_namespace, true, false);
 
+    // configuration is read from NVS only here, tasks use the RAM copy
+    ConfigStore::getInstance().load();
+
     // initialize newtwork interfaces
     ESP_ERROR_CHECK(esp_netif_init());
 
@@ -85,6 +89,9 @@ void Application::run()
         if (!_resetTask.init(literals::tsk_rst, tskIDLE_PRIORITY + 1ul, 4096))
             break;
 
+        if (!_storageTask.init(literals::tsk_storage, tskIDLE_PRIORITY + 1ul, 4096))
+            break;
+
         if (!_dsplTask.init(_connectionManager, literals::tsk_dspl, tskIDLE_PRIORITY + 1ul, 2*4096))
             break;
 
@@ -95,7 +102,7 @@ void Application::run()
             break;
 
 
-        waitForAllTasks({TaskBit::WiFi, TaskBit::Web, TaskBit::Reset, TaskBit::Display, TaskBit::Mqtt, TaskBit::Time});
+        waitForAllTasks({TaskBit::WiFi, TaskBit::Web, TaskBit::Reset, TaskBit::Display, TaskBit::Mqtt, TaskBit::Time, TaskBit::Storage});
 
         ESP_LOGI(TAG, "All tasks initialized. Proceeding...");
 
@@ -0,0 +1,153 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   asset_cache.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <stdio.h>
+#include <cstring>
+#include <string>
+#include <map>
+#include <sys/stat.h>
+#include <esp_http_server.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+/// @brief Web assets from SPIFFS cached in PSRAM. Each file is read from flash once,
+/// the gzipped variant (built by the CMake step as <name>.gz) is preferred.
+/// Only the httpd task touches the cache, so no locking is needed.
+class AssetCache
+{
+public:
+    struct Asset
+    {
+        uint8_t *data{nullptr};
+        size_t size{0};
+        bool gzip{false};
+        char etag[11]{}; ///< "xxxxxxxx" incl. quotes
+    };
+
+    AssetCache() = default;
+
+    ~AssetCache()
+    {
+        for (auto &[name, asset] : _assets)
+        {
+            heap_caps_free(asset.data);
+        }
+    }
+
+    AssetCache(AssetCache const &) = delete;
+    void operator=(AssetCache const &) = delete;
+
+    /// @brief Cached asset, loaded on the first request
+    /// @param path SPIFFS path without the .gz suffix
+    /// @return nullptr if the file does not exist
+    const Asset *get(const std::string &path)
+    {
+        auto it = _assets.find(path);
+        if (it != _assets.end())
+        {
+            return &it->second;
+        }
+
+        Asset asset;
+        if (load(path + ".gz", asset))
+        {
+            asset.gzip = true;
+        }
+        else if (!load(path, asset))
+        {
+            return nullptr;
+        }
+
+        ESP_LOGI(TAG, "Cached %s %u B%s etag %s", path.c_str(), (unsigned)asset.size, asset.gzip ? " gzip" : "", asset.etag);
+        return &_assets.emplace(path, asset).first->second;
+    }
+
+    /// @brief Sends cached asset, answers 304 if the client already has it
+    /// @param cacheControl Cache-Control header value
+    esp_err_t send(httpd_req_t *req, const std::string &path, const char *type, const char *cacheControl)
+    {
+        const Asset *asset = get(path);
+        if (!asset)
+        {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Initialize SPIFFS first!");
+            return ESP_FAIL;
+        }
+
+        httpd_resp_set_hdr(req, "ETag", asset->etag);
+        httpd_resp_set_hdr(req, "Cache-Control", cacheControl);
+
+        char match[sizeof(asset->etag) + 4];
+        if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK &&
+            strcmp(match, asset->etag) == 0)
+        {
+            httpd_resp_set_status(req, "304 Not Modified");
+            return httpd_resp_send(req, nullptr, 0);
+        }
+
+        httpd_resp_set_type(req, type);
+        if (asset->gzip)
+        {
+            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        }
+        return httpd_resp_send(req, reinterpret_cast<const char *>(asset->data), asset->size);
+    }
+
+private:
+    static constexpr const char *TAG = "AssetCache";
+    std::map<std::string, Asset> _assets;
+
+    static bool load(const std::string &path, Asset &asset)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            return false;
+        }
+
+        bool rc = false;
+        do
+        {
+            struct stat st;
+            if (fstat(fileno(file), &st) != 0 || st.st_size <= 0)
+                break;
+
+            asset.data = static_cast<uint8_t *>(heap_caps_malloc(st.st_size, MALLOC_CAP_SPIRAM));
+            if (!asset.data)
+            {
+                ESP_LOGE(TAG, "No PSRAM for %s", path.c_str());
+                break;
+            }
+
+            asset.size = fread(asset.data, 1, st.st_size, file);
+            if (asset.size != static_cast<size_t>(st.st_size))
+            {
+                heap_caps_free(asset.data);
+                asset.data = nullptr;
+                break;
+            }
+
+            snprintf(asset.etag, sizeof(asset.etag), "\"%08lx\"", static_cast<unsigned long>(fnv1a(asset.data, asset.size)));
+            rc = true;
+        } while (false);
+
+        fclose(file);
+        return rc;
+    }
+
+    static uint32_t fnv1a(const uint8_t *data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
@@ -0,0 +1,69 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   backoff.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include "esp_random.h"
+#include "esp_timer.h"
+
+/// @brief Exponential backoff with full jitter for reconnect attempts.
+/// The n-th delay is random in <base/2, min(cap, base * 2^n)>, so devices losing
+/// the same AP or broker do not retry in lockstep. Attempts are counted per hour.
+class Backoff
+{
+public:
+    /// @param baseMs first delay
+    /// @param capMs longest delay
+    constexpr Backoff(uint32_t baseMs, uint32_t capMs) : _baseMs(baseMs), _capMs(capMs) {}
+
+    /// @brief Delay before the next attempt, counts the attempt
+    uint32_t next()
+    {
+        countAttempt();
+        uint32_t ceiling = static_cast<uint32_t>(std::min<uint64_t>(_capMs, uint64_t(_baseMs) << std::min<uint32_t>(_step, 31)));
+        _step++;
+
+        uint32_t floor = std::min(_baseMs / 2, ceiling);
+        return floor + esp_random() % (ceiling - floor + 1);
+    }
+
+    /// @brief Connection established, the next failure starts from the base delay
+    void reset() { _step = 0; }
+
+    /// @brief Attempts since the last success
+    uint32_t step() const { return _step; }
+
+    uint32_t attempts() const { return _attempts; }
+
+    /// @brief Attempts in the last full hour
+    uint32_t attemptsLastHour() const { return _lastHour; }
+
+private:
+    void countAttempt()
+    {
+        int64_t now = esp_timer_get_time();
+        if (now - _hourStart >= 3600LL * 1000000)
+        {
+            // an idle hour (or more) ends the window with the attempts seen in it
+            _lastHour = (now - _hourStart < 2 * 3600LL * 1000000) ? _thisHour : 0;
+            _thisHour = 0;
+            _hourStart = now;
+        }
+        _thisHour++;
+        _attempts++;
+    }
+
+    uint32_t _baseMs;
+    uint32_t _capMs;
+    uint32_t _step{0};
+    uint32_t _attempts{0};
+    uint32_t _thisHour{0};
+    uint32_t _lastHour{0};
+    int64_t _hourStart{0};
+};
@@ -0,0 +1,189 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   checkpoint.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <inttypes.h>
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "shoelace.h"
+#include "energy_stats.h"
+
+/// @brief Crash-safe checkpoint of the energy accumulators in a dedicated NVS namespace.
+///
+/// Two slots are written alternately (A/B), each record carries a generation counter
+/// and CRC. A torn or corrupted write therefore never destroys the previous valid
+/// state; on load the valid slot with the highest generation wins. NVS itself spreads
+/// the writes over its pages (wear levelling), the caller bounds the write rate.
+class Checkpoint
+{
+public:
+    /// @brief Checkpointed state
+    struct Data
+    {
+        Shoelace::State consumption{};
+        Shoelace::State photovoltaic{};
+        EnergyStats::State stats{};
+        int32_t year{-1}; ///< tm_year of the day the counters belong to
+        int32_t yday{-1}; ///< tm_yday of the day the counters belong to
+    };
+
+    Checkpoint() = default;
+
+    ~Checkpoint()
+    {
+        if (_isInitialized)
+        {
+            nvs_close(_nvsHandle);
+        }
+    }
+
+    Checkpoint(Checkpoint const &) = delete;
+    void operator=(Checkpoint const &) = delete;
+
+    /// @brief Opens the namespace. NVS flash must be already initialized (KeyVal::init).
+    /// @param namespaceName dedicated namespace
+    /// @return true - success
+    bool init(const char *namespaceName)
+    {
+        if (_isInitialized)
+        {
+            return true;
+        }
+
+        esp_err_t ret = nvs_open(namespaceName, NVS_READWRITE, &_nvsHandle);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(ret));
+            return false;
+        }
+
+        _isInitialized = true;
+        return true;
+    }
+
+    /// @brief Store new checkpoint into the older slot
+    /// @param data state
+    /// @return true - success
+    bool save(const Data &data)
+    {
+        if (!_isInitialized)
+        {
+            return false;
+        }
+
+        Record rec{};
+        rec.magic = magic;
+        rec.version = version;
+        rec.generation = _generation + 1;
+        rec.data = data;
+        rec.crc = crc(rec);
+
+        esp_err_t err = nvs_set_blob(_nvsHandle, slotKey(rec.generation), &rec, sizeof(rec));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(_nvsHandle);
+        }
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Checkpoint %" PRIu32 " failed: %s", rec.generation, esp_err_to_name(err));
+            return false;
+        }
+
+        _generation = rec.generation;
+        ESP_LOGI(TAG, "Checkpoint %" PRIu32 " stored", _generation);
+        return true;
+    }
+
+    /// @brief Load the newest valid checkpoint
+    /// @param data state
+    /// @return true - valid checkpoint found
+    bool load(Data &data)
+    {
+        if (!_isInitialized)
+        {
+            return false;
+        }
+
+        Record a, b;
+        bool va = readSlot(slotA, a);
+        bool vb = readSlot(slotB, b);
+
+        if (!va && !vb)
+        {
+            ESP_LOGW(TAG, "No valid checkpoint");
+            return false;
+        }
+
+        const Record &rec = (va && (!vb || a.generation > b.generation)) ? a : b;
+        data = rec.data;
+        _generation = rec.generation;
+        ESP_LOGI(TAG, "Checkpoint %" PRIu32 " restored", _generation);
+        return true;
+    }
+
+    uint32_t generation() const { return _generation; }
+
+    /// @brief Checks if the checkpoint belongs to the given day
+    static bool isSameDay(const Data &data, time_t now)
+    {
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+        return data.year == tmNow.tm_year && data.yday == tmNow.tm_yday;
+    }
+
+private:
+    static constexpr const char *TAG = "Checkpoint";
+    static constexpr uint32_t magic = 0x50564350; // "PVCP"
+    static constexpr uint32_t version = 2; // 2 - EnergyKpi energies in double
+    static constexpr const char *slotA = "ckpt_a";
+    static constexpr const char *slotB = "ckpt_b";
+
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t generation;
+        uint32_t crc;
+        Data data;
+    };
+
+    static const char *slotKey(uint32_t generation)
+    {
+        return (generation & 1) ? slotA : slotB;
+    }
+
+    static uint32_t crc(const Record &rec)
+    {
+        return esp_rom_crc32_le(rec.generation, reinterpret_cast<const uint8_t *>(&rec.data), sizeof(rec.data));
+    }
+
+    bool readSlot(const char *key, Record &rec) const
+    {
+        size_t size = sizeof(rec);
+        if (nvs_get_blob(_nvsHandle, key, &rec, &size) != ESP_OK || size != sizeof(rec))
+        {
+            return false;
+        }
+
+        if (rec.magic != magic || rec.version != version || rec.crc != crc(rec))
+        {
+            ESP_LOGW(TAG, "Slot %s invalid", key);
+            return false;
+        }
+
+        return true;
+    }
+
+    nvs_handle_t _nvsHandle{0};
+    bool _isInitialized{false};
+    uint32_t _generation{0};
+};
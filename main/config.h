@@ -0,0 +1,372 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   config.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+#include <charconv>
+#include "esp_log.h"
+#include "key_val.h"
+#include "literals.h"
+#include "topic_trie.h"
+#include "power_profile.h"
+
+/// @brief Typed application configuration, the RAM copy of the NVS settings
+struct Config
+{
+    /// @brief Groups of fields, a subscriber is notified only about its groups
+    enum Group : uint32_t
+    {
+        Wifi = (1 << 0),       ///< ssid, password
+        Network = (1 << 1),    ///< static IP setup
+        Mqtt = (1 << 2),       ///< broker, credentials
+        Topic = (1 << 3),      ///< subscribed topic
+        Time = (1 << 4),       ///< time zone, NTP server
+        Checkpoint = (1 << 5), ///< counters checkpoint interval
+        Publish = (1 << 6),    ///< published metrics
+        Power = (1 << 7),      ///< power profile
+        All = 0xFFFFFFFF
+    };
+
+    std::string ssid{literals::kv_def_ssid};
+    std::string passwd;
+    std::string ip;
+    std::string mask;
+    std::string gw;
+    std::string dns;
+    std::string mqtt{literals::kv_def_mqtt};
+    std::string user;
+    std::string passwdbr;
+    std::string topic{literals::kv_def_topic}; ///< comma separated topic filters
+    std::string timezone{literals::kv_def_timezone};
+    std::string timeserver{literals::kv_def_timeserver};
+    std::string pubTopic{literals::kv_def_pubtopic};       ///< prefix of published topics
+    std::string power{literals::kv_def_power};             ///< PowerProfile name
+    uint32_t checkpointMin{literals::ckpt_def_interval}; ///< 0 - disabled
+    uint32_t pubIntervalSec{literals::kv_def_pubint};    ///< 0 - disabled
+
+    /// @brief String field description, the NVS key is also the form field name
+    struct Field
+    {
+        const char *key;
+        std::string Config::*member;
+        Group group;
+        const char *def;
+    };
+
+    static constexpr Field fields[] = {
+        {literals::kv_ssid, &Config::ssid, Wifi, literals::kv_def_ssid},
+        {literals::kv_passwd, &Config::passwd, Wifi, ""},
+        {literals::kv_ip, &Config::ip, Network, ""},
+        {literals::kv_mask, &Config::mask, Network, ""},
+        {literals::kv_gtw, &Config::gw, Network, ""},
+        {literals::kv_dns, &Config::dns, Network, ""},
+        {literals::kv_mqtt, &Config::mqtt, Mqtt, literals::kv_def_mqtt},
+        {literals::kv_user, &Config::user, Mqtt, ""},
+        {literals::kv_passwdbr, &Config::passwdbr, Mqtt, ""},
+        {literals::kv_topic, &Config::topic, Topic, literals::kv_def_topic},
+        {literals::kv_timezone, &Config::timezone, Time, literals::kv_def_timezone},
+        {literals::kv_timeserver, &Config::timeserver, Time, literals::kv_def_timeserver},
+        {literals::kv_pubtopic, &Config::pubTopic, Publish, literals::kv_def_pubtopic},
+        {literals::kv_power, &Config::power, Power, literals::kv_def_power},
+    };
+
+    static const Field *find(std::string_view key)
+    {
+        for (const auto &f : fields)
+        {
+            if (key == f.key)
+                return &f;
+        }
+        return nullptr;
+    }
+
+    /// @brief Number fields of the form (publish and checkpoint interval)
+    static constexpr const char *numbers[] = {literals::kv_pubint, literals::kv_ckpt};
+
+    /// @brief Set field by NVS key
+    /// @return false - unknown key or not a number
+    bool set(std::string_view key, std::string_view value)
+    {
+        if (uint32_t *num = number(key))
+        {
+            uint32_t n = 0;
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), n);
+            if (ec != std::errc() || end != value.data() + value.size())
+                return false;
+            *num = n;
+            return true;
+        }
+
+        const Field *f = find(key);
+        if (!f)
+            return false;
+        this->*(f->member) = value;
+        return true;
+    }
+
+    /// @brief Value of field by NVS key, empty for unknown key
+    std::string value(std::string_view key) const
+    {
+        if (key == literals::kv_pubint)
+            return std::to_string(pubIntervalSec);
+        if (key == literals::kv_ckpt)
+            return std::to_string(checkpointMin);
+
+        const Field *f = find(key);
+        return f ? this->*(f->member) : std::string();
+    }
+
+    /// @brief Checks one field
+    /// @return nullptr - valid, otherwise reason
+    const char *check(const Field &f) const
+    {
+        const std::string &v = this->*(f.member);
+
+        if (f.member == &Config::ssid)
+            return (v.empty() || v.size() > 32) ? "SSID must have 1-32 characters" : nullptr;
+        if (f.member == &Config::passwd)
+            return (!v.empty() && (v.size() < 8 || v.size() > 64)) ? "WiFi password must have 8-64 characters" : nullptr;
+        if (f.group == Network)
+            return (!v.empty() && !isIpv4(v)) ? "Invalid IPv4 address" : nullptr;
+        if (f.member == &Config::mqtt)
+            return (v.empty() || v.find(' ') != std::string::npos) ? "Invalid MQTT broker" : nullptr;
+        if (f.member == &Config::topic)
+        {
+            auto list = topics();
+            for (const auto &t : list)
+            {
+                if (!TopicTrie<int>::isValidFilter(t))
+                    return "Invalid MQTT topic filter";
+            }
+            return list.empty() ? "Value required" : nullptr;
+        }
+        if (f.member == &Config::pubTopic)
+            return (!TopicTrie<int>::isValidFilter(v) || v.find_first_of("+#") != std::string::npos) ? "Invalid publish topic" : nullptr;
+        if (f.member == &Config::power)
+            return PowerProfile::find(v) ? nullptr : "Power profile must be performance, balanced or saver";
+        if (f.member == &Config::timezone || f.member == &Config::timeserver)
+            return v.empty() ? "Value required" : nullptr;
+        return nullptr;
+    }
+
+    /// @brief Checks all fields
+    /// @param bad first invalid key (optional)
+    /// @return nullptr - valid, otherwise reason
+    const char *validate(const char **bad = nullptr) const
+    {
+        for (const auto &f : fields)
+        {
+            if (const char *reason = check(f))
+            {
+                if (bad)
+                    *bad = f.key;
+                return reason;
+            }
+        }
+
+        if (checkpointMin > 24 * 60)
+        {
+            if (bad)
+                *bad = literals::kv_ckpt;
+            return "Checkpoint interval must be 0-1440 min";
+        }
+
+        if (!isValidPubInterval(pubIntervalSec))
+        {
+            if (bad)
+                *bad = literals::kv_pubint;
+            return "Publish interval must be 0 or 10-3600 s";
+        }
+        return nullptr;
+    }
+
+    /// @brief Topic filters, e.g. "solax/data, heatpump/+/state, sensor/outdoor/#"
+    std::vector<std::string> topics() const
+    {
+        std::vector<std::string> list;
+        size_t start = 0;
+        while (start <= topic.size())
+        {
+            size_t end = topic.find(',', start);
+            if (end == std::string::npos)
+                end = topic.size();
+
+            size_t first = topic.find_first_not_of(' ', start);
+            size_t last = topic.find_last_not_of(' ', end - 1);
+            if (first < end && last != std::string::npos && last >= first)
+                list.push_back(topic.substr(first, last - first + 1));
+            start = end + 1;
+        }
+        return list;
+    }
+
+    /// @brief Groups where the two configurations differ
+    uint32_t diff(const Config &other) const
+    {
+        uint32_t changed = 0;
+        for (const auto &f : fields)
+        {
+            if (this->*(f.member) != other.*(f.member))
+                changed |= f.group;
+        }
+        if (checkpointMin != other.checkpointMin)
+            changed |= Checkpoint;
+        if (pubIntervalSec != other.pubIntervalSec)
+            changed |= Publish;
+        return changed;
+    }
+
+    /// @brief Number field by NVS key, nullptr - not a number field
+    uint32_t *number(std::string_view key)
+    {
+        if (key == literals::kv_pubint)
+            return &pubIntervalSec;
+        if (key == literals::kv_ckpt)
+            return &checkpointMin;
+        return nullptr;
+    }
+
+    static bool isValidPubInterval(uint32_t sec)
+    {
+        return sec == 0 || (sec >= 10 && sec <= 3600);
+    }
+
+    static bool isIpv4(const std::string &str)
+    {
+        unsigned a, b, c, d;
+        char tail;
+        return sscanf(str.c_str(), "%3u.%3u.%3u.%3u%c", &a, &b, &c, &d, &tail) == 4 &&
+               a <= 255 && b <= 255 && c <= 255 && d <= 255;
+    }
+};
+
+/// @brief Configuration loaded once at boot and kept in RAM.
+/// Readers get a copy, update() validates, stores only the changed values in one
+/// NVS commit and notifies subscribers of the changed groups.
+class ConfigStore
+{
+public:
+    /// @brief Called in the context of the updating task, keep it short
+    /// @param changed Config::Group mask of the changed groups
+    using Listener = std::function<void(const Config &cfg, uint32_t changed)>;
+
+    static ConfigStore &getInstance()
+    {
+        static ConfigStore instance;
+        return instance;
+    }
+
+    ConfigStore(ConfigStore const &) = delete;
+    void operator=(ConfigStore const &) = delete;
+
+    /// @brief Reads NVS (KeyVal must be initialized), invalid values fall back to defaults
+    void load()
+    {
+        KeyVal &kv = KeyVal::getInstance();
+        Config cfg;
+        for (const auto &f : Config::fields)
+        {
+            cfg.*(f.member) = kv.readString(f.key, f.def);
+            if (const char *reason = cfg.check(f))
+            {
+                ESP_LOGW(TAG, "%s: %s, default used", f.key, reason);
+                cfg.*(f.member) = f.def;
+            }
+        }
+
+        cfg.checkpointMin = kv.readUint32(literals::kv_ckpt, literals::ckpt_def_interval);
+        if (cfg.checkpointMin > 24 * 60)
+            cfg.checkpointMin = literals::ckpt_def_interval;
+
+        cfg.pubIntervalSec = kv.readUint32(literals::kv_pubint, literals::kv_def_pubint);
+        if (!Config::isValidPubInterval(cfg.pubIntervalSec))
+            cfg.pubIntervalSec = literals::kv_def_pubint;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _config = std::move(cfg);
+        ESP_LOGI(TAG, "Loaded, ssid [%s] broker [%s] topic [%s]", _config.ssid.c_str(), _config.mqtt.c_str(), _config.topic.c_str());
+    }
+
+    /// @brief Copy of the current configuration
+    Config get() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _config;
+    }
+
+    /// @brief Validates and stores the new configuration
+    /// @param reason why it was rejected (optional)
+    /// @return true - valid and stored
+    bool update(const Config &cfg, const char **reason = nullptr)
+    {
+        const char *bad = nullptr;
+        if (const char *why = cfg.validate(&bad))
+        {
+            ESP_LOGE(TAG, "Rejected %s: %s", bad, why);
+            if (reason)
+                *reason = why;
+            return false;
+        }
+
+        uint32_t changed = 0;
+        std::vector<std::pair<uint32_t, Listener>> listeners;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            changed = _config.diff(cfg);
+            if (changed == 0)
+                return true;
+
+            auto tx = KeyVal::getInstance().begin();
+            for (const auto &f : Config::fields)
+                tx.writeString(f.key, cfg.*(f.member));
+            tx.writeUint32(literals::kv_ckpt, cfg.checkpointMin);
+            tx.writeUint32(literals::kv_pubint, cfg.pubIntervalSec);
+            if (!tx.commit())
+            {
+                if (reason)
+                    *reason = "NVS write failed";
+                return false;
+            }
+
+            _config = cfg;
+            listeners = _listeners;
+        }
+
+        ESP_LOGI(TAG, "Updated, changed groups 0x%02lx", static_cast<unsigned long>(changed));
+
+        // outside the lock - a listener may call get()
+        for (const auto &[groups, listener] : listeners)
+        {
+            if (groups & changed)
+                listener(cfg, changed & groups);
+        }
+        return true;
+    }
+
+    /// @brief Register listener of the given Config::Group mask
+    void subscribe(uint32_t groups, Listener listener)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _listeners.emplace_back(groups, std::move(listener));
+    }
+
+private:
+    static constexpr const char *TAG = "Config";
+
+    ConfigStore() = default;
+
+    mutable std::mutex _mutex;
+    Config _config;
+    std::vector<std::pair<uint32_t, Listener>> _listeners;
+};
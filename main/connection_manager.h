@@ -9,6 +9,9 @@
 
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <vector>
+#include <functional>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
@@ -19,9 +22,26 @@
 #include <mqtt_client.h>
 #include <nvs_flash.h>
 
+/// @brief Connection states shared by the tasks (event group).
+/// Each state has a mirror bit set while the state is off, so a task can block
+/// until a state is set (waitFor) as well as until it is cleared (waitForClear).
+/// onChange listeners are called on edges only, in the context of the setter.
 class ConnectionManager
 {
 public:
+    /// @brief State bits for waitFor / waitForClear / onChange
+    enum Bit : EventBits_t
+    {
+        Wifi = BIT0, ///< STA has an IP address
+        Mqtt = BIT1, ///< broker connected
+        AP = BIT2,   ///< access point running
+        Time = BIT3  ///< time synchronized
+    };
+
+    /// @param changed bit that changed
+    /// @param state all state bits after the change
+    using Listener = std::function<void(EventBits_t changed, EventBits_t state)>;
+
     ConnectionManager()
     {
         event_group = xEventGroupCreate();
@@ -32,7 +52,8 @@ public:
         else
         {
             // Clear all bits to ensure a known initial state
-            xEventGroupClearBits(event_group, WIFI_CONNECTED_BIT | MQTT_CONNECTED_BIT);
+            xEventGroupClearBits(event_group, allBits);
+            xEventGroupSetBits(event_group, allBits << offShift);
         }
     }
 
@@ -47,27 +68,13 @@ public:
     // Sets Wifi as connected
     void setConnected()
     {
-        if (event_group)
-        { // Check if event_group is not NULL
-            xEventGroupSetBits(event_group, WIFI_CONNECTED_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setConnected");
-        }
+        update(Wifi, true);
     }
 
     // Sets Wifi as disconnected
     void setDisconnected()
     {
-        if (event_group)
-        {
-            xEventGroupClearBits(event_group, WIFI_CONNECTED_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setDisconnected");
-        }
+        update(Wifi, false);
     }
 
     // Checks if Wifi is connected
@@ -76,7 +83,7 @@ public:
         if (event_group)
         {
             EventBits_t bits = xEventGroupGetBits(event_group);
-            return bits & WIFI_CONNECTED_BIT;
+            return bits & Wifi;
         }
         else
         {
@@ -88,27 +95,13 @@ public:
     // Sets MQTT as active (connected)
     void setMqttActive()
     {
-        if (event_group)
-        {
-            xEventGroupSetBits(event_group, MQTT_CONNECTED_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setMqttActive");
-        }
+        update(Mqtt, true);
     }
 
     // Sets MQTT as inactive (disconnected)
     void setMqttDeactive()
     {
-        if (event_group)
-        {
-            xEventGroupClearBits(event_group, MQTT_CONNECTED_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setMqttDeactive");
-        }
+        update(Mqtt, false);
     }
 
     // Checks if MQTT is active
@@ -117,7 +110,7 @@ public:
         if (event_group)
         {
             EventBits_t bits = xEventGroupGetBits(event_group);
-            return bits & MQTT_CONNECTED_BIT;
+            return bits & Mqtt;
         }
         else
         {
@@ -129,27 +122,13 @@ public:
     // Sets AP as active (connected)
     void setAPActive()
     {
-        if (event_group)
-        {
-            xEventGroupSetBits(event_group, AP_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setAPActive");
-        }
+        update(AP, true);
     }
 
     // Sets AP as inactive (disconnected)
     void setAPDeactive()
     {
-        if (event_group)
-        {
-            xEventGroupClearBits(event_group, AP_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setAPDeactive");
-        }
+        update(AP, false);
     }
 
     // Checks if AP is active
@@ -158,7 +137,7 @@ public:
         if (event_group)
         {
             EventBits_t bits = xEventGroupGetBits(event_group);
-            return bits & AP_BIT;
+            return bits & AP;
         }
         else
         {
@@ -170,27 +149,13 @@ public:
     // Sets TIME as active (synced)
     void setTimeActive()
     {
-        if (event_group)
-        {
-            xEventGroupSetBits(event_group, TIME_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setTimeActive");
-        }
+        update(Time, true);
     }
 
     // Sets AP as inactive (not synced)
     void setTimeDeactive()
     {
-        if (event_group)
-        {
-            xEventGroupClearBits(event_group, TIME_BIT);
-        }
-        else
-        {
-            ESP_LOGE(LOG_TAG, "Event group is NULL in setTimeDeactive");
-        }
+        update(Time, false);
     }
 
     // Checks if TIME is synced
@@ -199,7 +164,7 @@ public:
         if (event_group)
         {
             EventBits_t bits = xEventGroupGetBits(event_group);
-            return bits & TIME_BIT;
+            return bits & Time;
         }
         else
         {
@@ -222,12 +187,76 @@ public:
         }
     }
 
+    /// @brief Blocks until the bits are set
+    /// @param all true - all bits, false - any of them
+    /// @return false - timeout
+    bool waitFor(EventBits_t bits, TickType_t timeout = portMAX_DELAY, bool all = true) const
+    {
+        if (!event_group)
+            return false;
+        EventBits_t got = xEventGroupWaitBits(event_group, bits, pdFALSE, all ? pdTRUE : pdFALSE, timeout) & bits;
+        return all ? got == bits : got != 0;
+    }
+
+    /// @brief Blocks until all the bits are cleared
+    /// @return false - timeout
+    bool waitForClear(EventBits_t bits, TickType_t timeout = portMAX_DELAY) const
+    {
+        return waitFor(bits << offShift, timeout, true);
+    }
+
+    /// @brief Calls the listener on every change of the given bits
+    void onChange(EventBits_t bits, Listener listener)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _listeners.emplace_back(bits, std::move(listener));
+    }
+
 private:
     static constexpr const char *LOG_TAG = "ConnectionManager";
+    static constexpr EventBits_t allBits = Wifi | Mqtt | AP | Time;
+    static constexpr int offShift = 8; ///< mirror bits of the cleared states
+
+    void update(EventBits_t bit, bool on)
+    {
+        if (!event_group)
+        {
+            ESP_LOGE(LOG_TAG, "Event group is NULL in update");
+            return;
+        }
+
+        EventBits_t state;
+        std::vector<std::pair<EventBits_t, Listener>> listeners;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            EventBits_t prev = xEventGroupGetBits(event_group);
+            if (on)
+            {
+                xEventGroupClearBits(event_group, bit << offShift);
+                xEventGroupSetBits(event_group, bit);
+            }
+            else
+            {
+                xEventGroupClearBits(event_group, bit);
+                xEventGroupSetBits(event_group, bit << offShift);
+            }
+
+            // repeated set / clear is not a change
+            if (((prev & bit) != 0) == on)
+                return;
+            state = ((prev & ~bit) | (on ? bit : 0)) & allBits;
+            listeners = _listeners;
+        }
+
+        // outside the lock - a listener may query the state
+        for (const auto &[bits, listener] : listeners)
+        {
+            if (bits & bit)
+                listener(bit, state);
+        }
+    }
 
     EventGroupHandle_t event_group;
-    static const int WIFI_CONNECTED_BIT = BIT0;
-    static const int MQTT_CONNECTED_BIT = BIT1;
-    static const int AP_BIT = BIT2;
-    static const int TIME_BIT = BIT3;
+    mutable std::mutex _mutex;
+    std::vector<std::pair<EventBits_t, Listener>> _listeners;
 };
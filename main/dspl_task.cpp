@@ -14,14 +14,17 @@
 #include "dspl_task.h"
 #include "application.h"
 #include "esp_log.h"
-#include "key_val.h"
+#include "config.h"
 #include "literals.h"
 #include "utils.h"
+#include "esp_timer.h"
 
-DisplayTask::DisplayTask() : _consumption("cons"), _photovoltaic("pv"), _sdcard("/sdcard", HW_SD_MOSI, HW_SD_MISO, HW_SD_CLK, HW_SD_CS)
+DisplayTask::DisplayTask() : _consumption("cons"), _photovoltaic("pv")
 {
     _queue = xQueueCreate(5, sizeof(DisplayTask::ReqData));
     _queueData = xQueueCreate(5, sizeof(SolaxParameters));
+    _queueLoad = xQueueCreate(2, sizeof(DisplayTask::LoadResult));
+    _checkpointDone = xSemaphoreCreateBinary();
 }
 
 DisplayTask::~DisplayTask()
@@ -32,6 +35,12 @@ DisplayTask::~DisplayTask()
 
     if (_queueData)
         vQueueDelete(_queueData);
+
+    if (_queueLoad)
+        vQueueDelete(_queueLoad);
+
+    if (_checkpointDone)
+        vSemaphoreDelete(_checkpointDone);
 }
 
 void DisplayTask::loop()
@@ -45,11 +54,25 @@ void DisplayTask::loop()
     screenManager->addScreen(std::make_unique<MainScreen>());
     screenManager->showScreenByType(ScreenType::Main);
 
-    mountOK = (_sdcard.mount(true) == ESP_OK);
-    if (!mountOK)
-        ESP_LOGE(TAG, "SD card mount failed - memory mode");
-    else
-        ESP_LOGW(TAG, "SD card mode active");
+    // SD card is owned by the storage task, wait for the mount result
+    auto *storage = Application::getInstance()->getStorageTask();
+    Application::getInstance()->waitForAllTasks({Application::TaskBit::Storage});
+    mountOK = storage->isMounted();
+
+    // restore counters before the first sample
+    bool checkpointRestored = restoreCheckpoint();
+    auto &config = ConfigStore::getInstance();
+    _checkpointMin = config.get().checkpointMin;
+    config.subscribe(Config::Checkpoint, [this](const Config &cfg, uint32_t)
+                     { _checkpointMin = cfg.checkpointMin; });
+    config.subscribe(Config::Publish, [this](const Config &, uint32_t)
+                     { _publisherReconfigure = true; });
+    _profile = &PowerProfile::get(config.get().power);
+    config.subscribe(Config::Power, [this](const Config &cfg, uint32_t)
+                     { _profile = &PowerProfile::get(cfg.power); });
+    _power.init();
+    _lastPowerLog = esp_timer_get_time();
+    int64_t lastCheckpoint = esp_timer_get_time();
 
     bool lastMqtt = false;
     bool lastConnection = _connectionManager ? _connectionManager->isConnected() : false;
@@ -61,12 +84,31 @@ void DisplayTask::loop()
     {
         vTaskDelay(1000 / portTICK_PERIOD_MS);
         ReqData req;
-        if (xQueueReceive(_queue, &req, 0) == pdTRUE)
+        while (xQueueReceive(_queue, &req, 0) == pdTRUE)
         {
             if (req.contnet == Contnet::UpdateData)
             {
                 ESP_LOGI(TAG, "LOG  [%s]", static_cast<const char *>(req.msg));
             }
+            else if (req.contnet == Contnet::StoreCheckpoint)
+            {
+                // counters are valid only after the restore for a synchronized day
+                _checkpointOk = !loadAfterReset && saveCheckpoint();
+                if (loadAfterReset)
+                    ESP_LOGW(TAG, "Checkpoint skipped, counters not restored yet");
+                xSemaphoreGive(_checkpointDone);
+            }
+            else if (req.contnet == Contnet::ShowMain)
+            {
+                screenManager->showScreenByType(ScreenType::Main);
+            }
+        }
+
+        LoadResult res;
+        while (xQueueReceive(_queueLoad, &res, 0) == pdTRUE)
+        {
+            applyDayFile(res);
+            delete res.content;
         }
 
         if (xQueueReceive(_queueData, &_SolaxData, 0) == pdTRUE)
@@ -105,21 +147,31 @@ void DisplayTask::loop()
                     _consumption.resetDailyConsumption();
                     _photovoltaic.resetDailyConsumption();
                     auto filename = "/" + Utils::getDayFileName();
-                    _sdcard.deleteFile(filename);
+                    storage->rotate(filename);
                     filename += ".pv";
-                    _sdcard.deleteFile(filename);
+                    storage->rotate(filename);
                     screenManager->clearAllDataSets();
                 }
                 else
                 {
 
-                    if (mountOK && loadAfterReset)
+                    if (loadAfterReset)
                     {
                         loadAfterReset = false;
-                        auto filename = "/" + Utils::getDayFileName();
-                        _consumption.load(_sdcard.readFile(filename));
-                        filename += ".pv";
-                        _photovoltaic.load(_sdcard.readFile(filename));
+
+                        if (checkpointRestored && !Checkpoint::isSameDay(_checkpointData, time(NULL)))
+                        {
+                            // checkpoint of another day - hourly counters are not valid
+                            ESP_LOGW(TAG, "Checkpoint is from another day");
+                            _consumption.restore(Shoelace::State{});
+                            _photovoltaic.restore(Shoelace::State{});
+                        }
+
+                        if (mountOK)
+                        {
+                            // day files are read asynchronously, the newer of SD card and checkpoint wins
+                            requestDayFiles();
+                        }
 
                         _consumption.updateChart([this, &screenManager](int hour, float consumption)
                                                  { screenManager->updateDataSetHour(1, hour, consumption); });
@@ -129,6 +181,15 @@ void DisplayTask::loop()
 
                     _consumption.update(solaxData.consumption);
                     _photovoltaic.update(solaxData.photovoltaic);
+                    _stats.update(solaxData, time(NULL));
+                    _publisher.sample(solaxData);
+
+                    const int64_t checkpointIntervalUs = int64_t(_checkpointMin.load()) * 60 * 1000000;
+                    if (checkpointIntervalUs > 0 && (esp_timer_get_time() - lastCheckpoint) >= checkpointIntervalUs)
+                    {
+                        lastCheckpoint = esp_timer_get_time();
+                        saveCheckpoint();
+                    }
                     //_consumption.dump();
 
                     screenManager->updateDataSetHour(1, hour, _consumption.getConsumptionForHour(hour));
@@ -139,14 +200,14 @@ void DisplayTask::loop()
                     {
                         lastMin = min;
                         auto filename = "/" + Utils::getDayFileName();
-                        if (_sdcard.writeFile(filename, _consumption.save()))
+                        if (!storage->write(filename, _consumption.save()))
                         {
-                            ESP_LOGI(TAG, "File written successfully %s", filename.c_str());
+                            ESP_LOGW(TAG, "Storage busy, %s not queued", filename.c_str());
                         }
                         filename += ".pv";
-                        if (_sdcard.writeFile(filename, _photovoltaic.save()))
+                        if (!storage->write(filename, _photovoltaic.save()))
                         {
-                            ESP_LOGI(TAG, "File written successfully %s", filename.c_str());
+                            ESP_LOGW(TAG, "Storage busy, %s not queued", filename.c_str());
                         }
                     }
                 }
@@ -156,6 +217,30 @@ void DisplayTask::loop()
 
             solaxData.sol = _SolaxData.Etoday_togrid * 100;
             solaxData.cons = (int)_consumption.getSum();
+            solaxData.kpiDay = _stats.day();
+            solaxData.kpiMonth = _stats.month();
+
+            // snapshot for REST API & SSE
+            float pv[24], cons[24];
+            for (int h = 0; h < 24; h++)
+            {
+                pv[h] = _photovoltaic.getConsumptionForHour(h);
+                cons[h] = _consumption.getConsumptionForHour(h);
+            }
+            Application::getInstance()->getWebTask()->liveData().update(solaxData, pv, cons, time(NULL));
+
+            // derived values back to MQTT
+            if (_publisherReconfigure.exchange(false))
+            {
+                Config cfg = ConfigStore::getInstance().get();
+                _publisher.configure(cfg.pubTopic, cfg.pubIntervalSec);
+            }
+            if (_connectionManager && _connectionManager->isTimeActive())
+            {
+                auto *mqtt = Application::getInstance()->getMqttTask();
+                _publisher.tick(time(NULL), solaxData, pv, cons, [mqtt](std::string_view topic, std::string payload, int qos, bool retain)
+                                { return mqtt->publish(topic, std::move(payload), qos, retain); });
+            }
         }
 
         // chcek connection error
@@ -194,11 +279,60 @@ void DisplayTask::loop()
             }
         }
 
+        updateBacklight(solaxData);
+        _power.sample(_backlight);
+        if (esp_timer_get_time() - _lastPowerLog >= int64_t(literals::power_log_interval_ms) * 1000)
+        {
+            _lastPowerLog = esp_timer_get_time();
+            powerReport();
+        }
+
         screenManager->solaxUpdate(solaxData);
         vTaskDelay(2000 / portTICK_PERIOD_MS);
     }
+}
+
+void DisplayTask::updateBacklight(const SolarData &data)
+{
+    const PowerProfile *profile = _profile;
+    bool off = false;
+    if (profile->nightBacklightOff && _connectionManager && _connectionManager->isTimeActive())
+    {
+        auto [hour, min, sec] = Utils::getTime();
+        off = hour >= literals::night_from_hour || hour < literals::night_to_hour;
+    }
+    if (profile->hdoBacklightOff && data.hdo)
+        off = true;
+
+    // a touch turns the dark screen on for a while
+    if (off)
+    {
+        DDLockGuard lock;
+        off = lv_disp_get_inactive_time(NULL) >= literals::backlight_wake_ms;
+    }
+
+    if (_backlight == !off)
+        return;
+    _backlight = !off;
+    ScreenManager::getInstance()->backLight(_backlight);
+}
+
+void DisplayTask::powerReport()
+{
+    const PowerProfile *profile = _profile;
+    auto st = _power.take();
+    auto lat = Application::getInstance()->getMqttTask()->latency(true);
 
-    _sdcard.unmount(); // never umnounted!!!
+    if (st.measured)
+        ESP_LOGI(TAG, "Power [%s] %lu mA (%lu..%lu), backlight %lu %%", profile->name, (unsigned long)st.avgMa,
+                 (unsigned long)st.minMa, (unsigned long)st.maxMa, (unsigned long)st.backlightPct);
+    else
+        ESP_LOGI(TAG, "Power [%s] backlight %lu %%", profile->name, (unsigned long)st.backlightPct);
+
+    ESP_LOGI(TAG, "Data [%s] %lu messages received, longest gap %lu ms", profile->name,
+             (unsigned long)lat.received, (unsigned long)lat.maxGapMs);
+    ESP_LOGI(TAG, "Broker round trip [%s] publish -> PUBACK %lu ms avg %lu ms max (%lu)", profile->name,
+             (unsigned long)lat.avgMs, (unsigned long)lat.maxMs, (unsigned long)lat.acks);
 }
 
 void DisplayTask::settingMsg(std::string_view msg)
@@ -218,6 +352,17 @@ void DisplayTask::settingMsg(std::string_view msg)
     }
 }
 
+void DisplayTask::showMain()
+{
+    if (_queue)
+    {
+        ReqData rqdt;
+        rqdt.contnet = Contnet::ShowMain;
+        rqdt.msg[0] = '\0';
+        xQueueSendToBack(_queue, &rqdt, 0);
+    }
+}
+
 void DisplayTask::updateUI(const SolaxParameters &msg)
 {
     if (_queueData)
@@ -226,6 +371,91 @@ void DisplayTask::updateUI(const SolaxParameters &msg)
     }
 }
 
+bool DisplayTask::checkpointNow(TickType_t wait)
+{
+    if (!_queue || !_checkpointDone)
+        return false;
+
+    ReqData rqdt;
+    rqdt.contnet = Contnet::StoreCheckpoint;
+    rqdt.msg[0] = '\0';
+    xSemaphoreTake(_checkpointDone, 0); // answer of an earlier timed out request
+    if (xQueueSendToBack(_queue, &rqdt, 0) != pdTRUE)
+        return false;
+
+    return xSemaphoreTake(_checkpointDone, wait) == pdTRUE && _checkpointOk;
+}
+
+void DisplayTask::requestDayFiles()
+{
+    auto *storage = Application::getInstance()->getStorageTask();
+    auto filename = "/" + Utils::getDayFileName();
+
+    _loadBaseline[0] = _photovoltaic.state().lastUpdateTime;
+    _loadBaseline[1] = _consumption.state().lastUpdateTime;
+
+    auto post = [this](int dataset)
+    {
+        return [this, dataset](bool ok, std::string &&content)
+        {
+            if (!ok)
+                return;
+
+            LoadResult res{dataset, new std::string(std::move(content))};
+            if (xQueueSendToBack(_queueLoad, &res, pdMS_TO_TICKS(1000)) != pdTRUE)
+                delete res.content;
+        };
+    };
+
+    storage->read(filename, post(1));
+    storage->read(filename + ".pv", post(0));
+}
+
+void DisplayTask::applyDayFile(const LoadResult &res)
+{
+    Shoelace &target = (res.dataset == 0) ? _photovoltaic : _consumption;
+    Shoelace loaded("sd");
+
+    // compare with the state at the time of the request, target has been updated since then
+    if (!loaded.load(*res.content) || loaded.state().lastUpdateTime < _loadBaseline[res.dataset])
+        return;
+
+    ESP_LOGI(TAG, "Day file %d restored from SD card", res.dataset);
+    target.restore(loaded.state());
+
+    auto *screenManager = ScreenManager::getInstance();
+    target.updateChart([screenManager, &res](int hour, float consumption)
+                       { screenManager->updateDataSetHour(res.dataset, hour, consumption); });
+}
+
+bool DisplayTask::restoreCheckpoint()
+{
+    if (!_checkpoint.init(literals::ckpt_namespace))
+        return false;
+
+    if (!_checkpoint.load(_checkpointData))
+        return false;
+
+    _consumption.restore(_checkpointData.consumption);
+    _photovoltaic.restore(_checkpointData.photovoltaic);
+    _stats.restore(_checkpointData.stats);
+    return true;
+}
+
+bool DisplayTask::saveCheckpoint()
+{
+    time_t now = time(NULL);
+    struct tm tmNow;
+    localtime_r(&now, &tmNow);
+
+    _checkpointData.consumption = _consumption.state();
+    _checkpointData.photovoltaic = _photovoltaic.state();
+    _checkpointData.stats = _stats.state();
+    _checkpointData.year = tmNow.tm_year;
+    _checkpointData.yday = tmNow.tm_yday;
+    return _checkpoint.save(_checkpointData);
+}
+
 bool DisplayTask::init(std::shared_ptr<ConnectionManager> connMgr, const char *name, UBaseType_t priority, const configSTACK_DEPTH_TYPE stackDepth)
 {
     bool rc = false;
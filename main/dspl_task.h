@@ -7,13 +7,18 @@
 
 #pragma once
 
+#include <atomic>
 #include "hardware.h"
 #include "rptask.h"
 #include "connection_manager.h"
 #include "mqtt_queue_data.h"
 #include "shoelace.h"
-#include "sd_card.h"
+#include "energy_stats.h"
+#include "checkpoint.h"
+#include "metrics_publisher.h"
 #include "main_screen.h"
+#include "power_profile.h"
+#include "power_monitor.h"
 
 
 class DisplayTask : public RPTask
@@ -25,7 +30,9 @@ public:
 		NoWifi,			// error mesage - wifi
 		NoMqtt, 		// error message - mqtt
 		Running, 		// wifi & mqtt - ok - energy bar displayed
-		UpdateData		// update container for setting view
+		UpdateData,		// update container for setting view
+		StoreCheckpoint,	// store checkpoint now
+		ShowMain		// back to the main screen
 	};
 
 	// Update message which I will send to the screen
@@ -38,19 +45,50 @@ public:
 	virtual ~DisplayTask();
 	void settingMsg(std::string_view msg);
 	void updateUI(const SolaxParameters& msg);
+	/// @brief Stores the counters now, waits for the display task
+	/// @return false - not saved (timeout, counters not restored yet, NVS error)
+	bool checkpointNow(TickType_t wait = pdMS_TO_TICKS(5000));
+	void showMain();
 	bool init(std::shared_ptr<ConnectionManager> connMgr, const char *name, UBaseType_t priority, const configSTACK_DEPTH_TYPE stackDepth);
 
 protected:
 	void loop() override;
 
+private:
+	// day file loaded by the storage task, content is heap owned
+	struct LoadResult {
+		int dataset;			// 0 - photovoltaic, 1 - consumption
+		std::string *content;
+	};
+
+	bool restoreCheckpoint();
+	bool saveCheckpoint();
+	void requestDayFiles();
+	void applyDayFile(const LoadResult &res);
+	void updateBacklight(const SolarData &data);
+	void powerReport();
+
 private:
 	static constexpr const char *TAG = "DisplayTask";
 	QueueHandle_t 	_queue;
 	QueueHandle_t 	_queueData;
+	QueueHandle_t 	_queueLoad;
 	std::shared_ptr<ConnectionManager> _connectionManager;
 	SolaxParameters  _SolaxData;
 	Shoelace		 _consumption;
 	Shoelace         _photovoltaic;
-	SdCard			 _sdcard;
+	EnergyStats      _stats;
+	time_t			 _loadBaseline[2]{0, 0};
+	Checkpoint		 _checkpoint;
+	Checkpoint::Data _checkpointData;
+	SemaphoreHandle_t _checkpointDone;
+	std::atomic<bool> _checkpointOk{false};	///< result of the last StoreCheckpoint request
+	std::atomic<uint32_t> _checkpointMin{0};	///< minutes, 0 - disabled
+	MetricsPublisher _publisher;
+	std::atomic<bool> _publisherReconfigure{true};	///< publish settings changed
+	std::atomic<const PowerProfile *> _profile{nullptr};
+	PowerMonitor	 _power;
+	bool			 _backlight{true};
+	int64_t			 _lastPowerLog{0};
 	
 };
@@ -0,0 +1,153 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   energy_stats.h  Incremental energy analytics
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "ui_transfer.h"
+
+/// @brief Running daily and monthly KPIs (autarky, self-consumption, peaks, battery cycles).
+/// Every sample is integrated with the trapezoid (shoelace) rule, so one update is O(1)
+/// and no history has to be rescanned.
+class EnergyStats
+{
+public:
+    /// @brief Instantaneous power flows derived from one sample (W, all non-negative).
+    struct Flows
+    {
+        float pv{0};
+        float load{0};
+        float gridIn{0};
+        float gridOut{0};
+        float charge{0};
+        float discharge{0};
+    };
+
+    /// @brief Complete accumulator state, plain data so it can be checkpointed.
+    struct State
+    {
+        EnergyKpi day{};
+        EnergyKpi month{};
+        Flows last{};
+        time_t lastUpdateTime{0};
+        int32_t lastSoc{-1};
+        int32_t year{-1};
+        int32_t yday{-1};
+        int32_t mon{-1};
+    };
+
+    EnergyStats() = default;
+
+    /// @brief Feed one sample. Expects SolarData::updateDerivedValues() to be already called.
+    /// @param sol sample
+    /// @param now wall clock time of the sample (must be synchronized)
+    void update(const SolarData &sol, time_t now)
+    {
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+        rollover(tmNow);
+
+        Flows cur = flows(sol);
+
+        if (_st.lastUpdateTime != 0 && now > _st.lastUpdateTime)
+        {
+            double dtHours = difftime(now, _st.lastUpdateTime) / 3600.0;
+            // do not bridge long gaps (outage, reboot) with a straight line
+            if (dtHours <= maxGapHours)
+            {
+                integrate(_st.day, cur, dtHours);
+                integrate(_st.month, cur, dtHours);
+            }
+        }
+
+        peaks(_st.day, cur);
+        peaks(_st.month, cur);
+
+        // equivalent full cycles from the discharged state of charge
+        if (_st.lastSoc >= 0 && sol.batteryCapacity < _st.lastSoc)
+        {
+            float c = (_st.lastSoc - sol.batteryCapacity) / 100.0f;
+            _st.day.cycles += c;
+            _st.month.cycles += c;
+        }
+
+        _st.lastSoc = sol.batteryCapacity;
+        _st.last = cur;
+        _st.lastUpdateTime = now;
+    }
+
+    const EnergyKpi &day() const { return _st.day; }
+    const EnergyKpi &month() const { return _st.month; }
+
+    const State &state() const { return _st; }
+    void restore(const State &st) { _st = st; }
+
+    void dump() const
+    {
+        ESP_LOGI(TAG, "Day   PV %.0f Wh load %.0f Wh autarky %.1f %% self %.1f %% batt %.0f Wh cycles %.2f",
+                 _st.day.pvWh, _st.day.loadWh, _st.day.autarky(), _st.day.selfConsumption(), _st.day.battDischargeWh, _st.day.cycles);
+        ESP_LOGI(TAG, "Month PV %.0f Wh load %.0f Wh autarky %.1f %% self %.1f %% batt %.0f Wh cycles %.2f",
+                 _st.month.pvWh, _st.month.loadWh, _st.month.autarky(), _st.month.selfConsumption(), _st.month.battDischargeWh, _st.month.cycles);
+    }
+
+private:
+    static constexpr const char *TAG = "EnergyStats";
+    static constexpr double maxGapHours = 0.25; ///< longer gaps are not integrated
+    State _st{};
+
+    static Flows flows(const SolarData &sol)
+    {
+        Flows f;
+        f.pv = std::max(0.0f, sol.photovoltaic);
+        f.load = std::max(0.0f, sol.consumption);
+        f.gridIn = std::max(0.0f, -sol.feedinPower);
+        f.gridOut = std::max(0.0f, sol.feedinPower);
+        f.charge = std::max(0.0f, sol.batteryChargePower);
+        f.discharge = std::max(0.0f, -sol.batteryChargePower);
+        return f;
+    }
+
+    void integrate(EnergyKpi &k, const Flows &cur, double dtHours) const
+    {
+        const Flows &l = _st.last;
+        k.pvWh += (l.pv + cur.pv) / 2 * dtHours;
+        k.loadWh += (l.load + cur.load) / 2 * dtHours;
+        k.importWh += (l.gridIn + cur.gridIn) / 2 * dtHours;
+        k.exportWh += (l.gridOut + cur.gridOut) / 2 * dtHours;
+        k.battChargeWh += (l.charge + cur.charge) / 2 * dtHours;
+        k.battDischargeWh += (l.discharge + cur.discharge) / 2 * dtHours;
+    }
+
+    static void peaks(EnergyKpi &k, const Flows &cur)
+    {
+        k.peakPv = std::max(k.peakPv, cur.pv);
+        k.peakLoad = std::max(k.peakLoad, cur.load);
+    }
+
+    void rollover(const struct tm &tmNow)
+    {
+        if (_st.year != tmNow.tm_year || _st.yday != tmNow.tm_yday)
+        {
+            if (_st.yday >= 0)
+                ESP_LOGI(TAG, "Day rollover");
+            _st.day = EnergyKpi{};
+        }
+
+        if (_st.year != tmNow.tm_year || _st.mon != tmNow.tm_mon)
+        {
+            if (_st.mon >= 0)
+                ESP_LOGI(TAG, "Month rollover");
+            _st.month = EnergyKpi{};
+        }
+
+        _st.year = tmNow.tm_year;
+        _st.yday = tmNow.tm_yday;
+        _st.mon = tmNow.tm_mon;
+    }
+};
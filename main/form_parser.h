@@ -0,0 +1,124 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   form_parser.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <string_view>
+#include <functional>
+#include <cstddef>
+#include "utils.h"
+
+/// @brief Streaming application/x-www-form-urlencoded parser.
+/// Data are fed in arbitrary chunks (as httpd_req_recv delivers them), every completed
+/// key=value pair is URL-decoded in place in a fixed buffer and passed to the callback.
+/// No allocation, the whole body is never held in memory.
+class FormParser
+{
+public:
+    /// @brief Called for each complete pair, views are valid only during the call
+    using PairCallback = std::function<void(std::string_view key, std::string_view value)>;
+
+    static constexpr size_t maxKey = 24;
+    static constexpr size_t maxValue = 256; ///< encoded length (a 64 B password may need 192 B)
+    static constexpr size_t maxBody = 4096;
+    static constexpr size_t recvChunk = 128; ///< receive buffer of the POST handler
+
+    /// @brief Body size accepted before receiving (Content-Length)
+    static bool isValidLength(size_t len) { return len > 0 && len <= maxBody; }
+
+    explicit FormParser(PairCallback callback) : _callback(std::move(callback)) {}
+
+    /// @brief Consume next part of the body
+    void feed(const char *data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            char c = data[i];
+            switch (c)
+            {
+            case '&':
+                complete();
+                break;
+
+            case '=':
+                if (_state == State::Key)
+                {
+                    _state = State::Value;
+                    break;
+                }
+                [[fallthrough]]; // '=' inside value is taken as it is
+
+            default:
+                if (_state == State::Key)
+                    push(_key, _keyLen, maxKey, c);
+                else if (_state == State::Value)
+                    push(_value, _valueLen, maxValue, c);
+                break;
+            }
+        }
+    }
+
+    /// @brief End of the body, completes the last pair
+    void finish()
+    {
+        complete();
+    }
+
+    /// @brief Number of pairs dropped (too long, empty key or without '=')
+    int errors() const { return _errors; }
+
+    /// @brief Number of pairs passed to the callback
+    int pairs() const { return _pairs; }
+
+private:
+    enum class State
+    {
+        Key,
+        Value,
+        Skip ///< overflow - ignore the rest of the pair
+    };
+
+    void push(char *buf, size_t &len, size_t max, char c)
+    {
+        if (len < max)
+        {
+            buf[len++] = c;
+        }
+        else
+        {
+            _state = State::Skip;
+        }
+    }
+
+    void complete()
+    {
+        if (_state == State::Value && _keyLen > 0)
+        {
+            size_t k = Utils::urlDecodeInPlace(_key, _keyLen);
+            size_t v = Utils::urlDecodeInPlace(_value, _valueLen);
+            _callback(std::string_view(_key, k), std::string_view(_value, v));
+            _pairs++;
+        }
+        else if (_state != State::Key || _keyLen > 0)
+        {
+            _errors++;
+        }
+
+        _state = State::Key;
+        _keyLen = 0;
+        _valueLen = 0;
+    }
+
+    PairCallback _callback;
+    State _state{State::Key};
+    char _key[maxKey];
+    size_t _keyLen{0};
+    char _value[maxValue];
+    size_t _valueLen{0};
+    int _errors{0};
+    int _pairs{0};
+};
@@ -84,6 +84,13 @@ EXIO5      USB_SEL     USB    -> LOW
 #define HW_SD_MISO GPIO_NUM_13
 #define HW_SD_CLK  GPIO_NUM_12
 #define HW_SD_CS  GPIO_NUM_NC
+#define HW_SD_FREQ_KHZ  40000     // SPI clock (IOMUX pins of SPI2), mount retries at 20 MHz if the card refuses
+
+// SUPPLY CURRENT (optional shunt amplifier on the Sensor AD pin, GPIO6)
+
+#define HW_SHUNT_ADC_UNIT       ADC_UNIT_1
+#define HW_SHUNT_ADC_CHANNEL    ADC_CHANNEL_5
+#define HW_SHUNT_MV_PER_A       0         // amplifier output, 0 - no shunt fitted (50 mOhm + INA181A1 x20 -> 1000)
 
 // DISPLAY
 
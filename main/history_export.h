@@ -0,0 +1,252 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   history_export.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <cstring>
+#include <string>
+#include <functional>
+#include <esp_http_server.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+/// @brief Streams the hourly history stored on the SD card (day files DDMM and DDMM.pv)
+/// as CSV or JSON. Day files are read one at a time through the reader (the storage
+/// task owns the card) and the output goes out through httpd_resp_send_chunk, so the
+/// RAM use does not depend on the range.
+///
+/// GET /export?from=YYYY-MM-DD&to=YYYY-MM-DD&format=csv|json
+///
+/// Day files carry no year, each one is overwritten at the same day of the next year.
+/// The range is therefore clamped to the last year and a file whose last update does not
+/// belong to the requested date is skipped.
+class HistoryExport
+{
+public:
+    /// @brief Reads a whole file, path relative to the card root (/DDMM)
+    using FileReader = std::function<bool(const std::string &path, std::string &content)>;
+
+    HistoryExport(httpd_req_t *req, FileReader reader) : _req(req), _reader(std::move(reader)) {}
+
+    HistoryExport(HistoryExport const &) = delete;
+    void operator=(HistoryExport const &) = delete;
+
+    esp_err_t run()
+    {
+        time_t from, to;
+        bool json = false;
+        if (!parseQuery(from, to, json))
+        {
+            httpd_resp_send_err(_req, HTTPD_400_BAD_REQUEST, "Use ?from=YYYY-MM-DD&to=YYYY-MM-DD&format=csv|json");
+            return ESP_FAIL;
+        }
+
+        size_t heapBefore = esp_get_free_heap_size();
+        int days = 0;
+
+        httpd_resp_set_type(_req, json ? "application/json" : "text/csv");
+        httpd_resp_set_hdr(_req, "Content-Disposition", json ? "attachment; filename=\"history.json\"" : "attachment; filename=\"history.csv\"");
+
+        put(json ? "[" : "date,hour,pv_wh,consumption_wh\n");
+
+        for (time_t day = from; day <= to && _ok; day += secondsPerDay)
+        {
+            struct tm tmDay;
+            localtime_r(&day, &tmDay);
+
+            Day pv, cons;
+            bool hasPv = readDay(tmDay, ".pv", pv);
+            bool hasCons = readDay(tmDay, "", cons);
+            if (!hasPv && !hasCons)
+                continue;
+
+            char date[11];
+            strftime(date, sizeof(date), "%Y-%m-%d", &tmDay);
+
+            if (json)
+            {
+                print("%s{\"date\":\"%s\",\"pv\":[", days ? "," : "", date);
+                series(pv, hasPv);
+                put("],\"cons\":[");
+                series(cons, hasCons);
+                put("]}");
+            }
+            else
+            {
+                for (int h = 0; h < 24 && _ok; h++)
+                {
+                    print("%s,%d,%.1f,%.1f\n", date, h, hasPv ? pv.hourly[h] : 0.0f, hasCons ? cons.hourly[h] : 0.0f);
+                }
+            }
+            days++;
+        }
+
+        if (json)
+            put("]");
+
+        if (_ok)
+            flush();
+
+        // terminating chunk
+        httpd_resp_send_chunk(_req, nullptr, 0);
+
+        ESP_LOGI(TAG, "Exported %d days, heap before %u after %u, min free %u", days,
+                 (unsigned)heapBefore, (unsigned)esp_get_free_heap_size(), (unsigned)esp_get_minimum_free_heap_size());
+        return _ok ? ESP_OK : ESP_FAIL;
+    }
+
+private:
+    static constexpr const char *TAG = "Export";
+    static constexpr time_t secondsPerDay = 24 * 3600;
+    static constexpr int maxDays = 366;
+
+    struct Day
+    {
+        float hourly[24];
+    };
+
+    httpd_req_t *_req;
+    FileReader _reader;
+    char _out[1024];
+    size_t _len{0};
+    bool _ok{true};
+
+    /// @brief Parses YYYY-MM-DD as local noon (safe against DST shifts while stepping days)
+    static bool parseDate(const char *str, time_t &t)
+    {
+        struct tm tmDate = {};
+        if (sscanf(str, "%4d-%2d-%2d", &tmDate.tm_year, &tmDate.tm_mon, &tmDate.tm_mday) != 3)
+            return false;
+
+        tmDate.tm_year -= 1900;
+        tmDate.tm_mon -= 1;
+        tmDate.tm_hour = 12;
+        tmDate.tm_isdst = -1;
+        t = mktime(&tmDate);
+        return t != -1;
+    }
+
+    bool parseQuery(time_t &from, time_t &to, bool &json) const
+    {
+        char query[96];
+        char value[16];
+
+        time_t now = time(NULL);
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+        tmNow.tm_hour = 12;
+        tmNow.tm_min = tmNow.tm_sec = 0;
+        tmNow.tm_isdst = -1;
+        time_t today = mktime(&tmNow);
+
+        to = today;
+        from = today - (maxDays - 1) * secondsPerDay;
+
+        if (httpd_req_get_url_query_str(_req, query, sizeof(query)) == ESP_OK)
+        {
+            if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK && !parseDate(value, from))
+                return false;
+            if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK && !parseDate(value, to))
+                return false;
+            if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK)
+                json = (strcmp(value, "json") == 0);
+        }
+
+        // only the last year is kept on the card
+        if (to > today)
+            to = today;
+        if (from < today - (maxDays - 1) * secondsPerDay)
+            from = today - (maxDays - 1) * secondsPerDay;
+
+        return from <= to;
+    }
+
+    /// @brief Reads and parses one day file (Shoelace::save format, a few hundred bytes)
+    bool readDay(const struct tm &tmDay, const char *suffix, Day &day) const
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "/%02d%02d%s", tmDay.tm_mday, tmDay.tm_mon + 1, suffix);
+
+        std::string content;
+        if (!_reader(name, content))
+            return false;
+
+        const char *p = content.c_str();
+        char *end = nullptr;
+        for (int h = 0; h < 24; h++)
+        {
+            day.hourly[h] = strtof(p, &end);
+            if (end == p || *end != ',')
+                return false;
+            p = end + 1;
+        }
+
+        strtof(p, &end); // last power
+        if (end == p || *end != ',')
+            return false;
+        time_t lastUpdate = static_cast<time_t>(strtoll(end + 1, nullptr, 10));
+
+        // file of the same day in a previous year
+        struct tm tmFile;
+        localtime_r(&lastUpdate, &tmFile);
+        return tmFile.tm_year == tmDay.tm_year && tmFile.tm_yday == tmDay.tm_yday;
+    }
+
+    void series(const Day &day, bool valid)
+    {
+        for (int h = 0; h < 24; h++)
+        {
+            print(h ? ",%.1f" : "%.1f", valid ? day.hourly[h] : 0.0f);
+        }
+    }
+
+    void put(const char *str)
+    {
+        print("%s", str);
+    }
+
+    __attribute__((format(printf, 2, 3))) void print(const char *fmt, ...)
+    {
+        if (!_ok)
+            return;
+
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            va_list args;
+            va_start(args, fmt);
+            int n = vsnprintf(_out + _len, sizeof(_out) - _len, fmt, args);
+            va_end(args);
+
+            if (n < 0)
+                return;
+
+            if (_len + n < sizeof(_out))
+            {
+                _len += n;
+                return;
+            }
+
+            // does not fit, send what we have and retry in the empty buffer
+            _out[_len] = '\0';
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if (_len > 0 && httpd_resp_send_chunk(_req, _out, _len) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Client closed the export");
+            _ok = false;
+        }
+        _len = 0;
+    }
+};
@@ -0,0 +1,165 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   html_template.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <cstring>
+#include <esp_http_server.h>
+#include "esp_log.h"
+
+/// @brief HTML template with %NAME% placeholders (NAME = A-Z, 0-9, _).
+/// The source is split into literal and placeholder segments once, rendering is a single
+/// pass which streams the segments with httpd_resp_send_chunk. The template does not own
+/// the source, it must outlive the template (AssetCache keeps it in PSRAM).
+class HtmlTemplate
+{
+public:
+    /// @brief Returns value of the placeholder, the value is HTML escaped on output
+    using Resolver = std::function<std::string(std::string_view name)>;
+
+    HtmlTemplate() = default;
+
+    /// @brief Split the source into segments
+    /// @return false if source is empty
+    bool parse(std::string_view source)
+    {
+        _segments.clear();
+        size_t literal = 0;
+        size_t pos = 0;
+
+        while ((pos = source.find('%', pos)) != std::string_view::npos)
+        {
+            size_t end = pos + 1;
+            while (end < source.size() && isNameChar(source[end]))
+                end++;
+
+            if (end == pos + 1 || end >= source.size() || source[end] != '%')
+            {
+                // plain percent sign (e.g. width: 100%)
+                pos++;
+                continue;
+            }
+
+            if (pos > literal)
+                _segments.push_back({source.substr(literal, pos - literal), false});
+            _segments.push_back({source.substr(pos + 1, end - pos - 1), true});
+            literal = pos = end + 1;
+        }
+
+        if (literal < source.size())
+            _segments.push_back({source.substr(literal), false});
+
+        ESP_LOGI(TAG, "Parsed %u segments", (unsigned)_segments.size());
+        return !source.empty();
+    }
+
+    bool isParsed() const { return !_segments.empty(); }
+
+    /// @brief Stream the rendered page
+    esp_err_t render(httpd_req_t *req, const Resolver &resolver)
+    {
+        Output out(req);
+
+        for (const auto &seg : _segments)
+        {
+            if (seg.placeholder)
+                out.escaped(resolver(seg.text));
+            else
+                out.raw(seg.text);
+        }
+
+        return out.finish();
+    }
+
+private:
+    static constexpr const char *TAG = "HtmlTemplate";
+
+    struct Segment
+    {
+        std::string_view text; ///< literal text or placeholder name
+        bool placeholder;
+    };
+
+    /// @brief Chunked output. Short pieces are coalesced in a small buffer,
+    /// long literals are sent directly from the template source.
+    class Output
+    {
+    public:
+        explicit Output(httpd_req_t *req) : _req(req) {}
+
+        void raw(std::string_view text)
+        {
+            if (text.size() >= sizeof(_buf) / 2)
+            {
+                flush();
+                send(text.data(), text.size());
+                return;
+            }
+
+            if (_len + text.size() > sizeof(_buf))
+                flush();
+            memcpy(_buf + _len, text.data(), text.size());
+            _len += text.size();
+        }
+
+        void escaped(std::string_view text)
+        {
+            size_t pos;
+            while ((pos = text.find_first_of("&<>\"'")) != std::string_view::npos)
+            {
+                raw(text.substr(0, pos));
+                switch (text[pos])
+                {
+                case '&': raw("&amp;"); break;
+                case '<': raw("&lt;"); break;
+                case '>': raw("&gt;"); break;
+                case '"': raw("&quot;"); break;
+                default: raw("&#39;"); break;
+                }
+                text.remove_prefix(pos + 1);
+            }
+            raw(text);
+        }
+
+        esp_err_t finish()
+        {
+            flush();
+            if (_rc == ESP_OK)
+                _rc = httpd_resp_send_chunk(_req, nullptr, 0);
+            return _rc;
+        }
+
+    private:
+        void flush()
+        {
+            send(_buf, _len);
+            _len = 0;
+        }
+
+        void send(const char *data, size_t size)
+        {
+            if (size > 0 && _rc == ESP_OK)
+                _rc = httpd_resp_send_chunk(_req, data, size);
+        }
+
+        httpd_req_t *_req;
+        char _buf[256];
+        size_t _len{0};
+        esp_err_t _rc{ESP_OK};
+    };
+
+    static bool isNameChar(char c)
+    {
+        return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    std::vector<Segment> _segments;
+};
@@ -19,6 +19,7 @@ public:
         _config.stack_size = 8192;
         _config.recv_wait_timeout = 2; 
         _config.send_wait_timeout = 2;  
+        _config.max_uri_handlers = 12;
     }
 
     ~HttpServer() {
@@ -59,6 +60,8 @@ public:
         return true;
     }
 
+    httpd_handle_t handle() const { return _server; }
+
     void stop() {
         if (_server != nullptr) {
             httpd_stop(_server);
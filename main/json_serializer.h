@@ -15,7 +15,7 @@
 class JsonSerializer
 {
 public:
-    static void updateSolaxParameter(SolaxParameters &params, const std::string &key, int32_t value)
+    static void updateSolaxParameter(SolaxParameters &params, std::string_view key, int32_t value)
     {
         if (key == "PvVoltage1")
         {
@@ -111,7 +111,7 @@ public:
         }
         else
         {
-            ESP_LOGW("SolaxParameters", "Unknown key: %s", key.c_str());
+            ESP_LOGW("SolaxParameters", "Unknown key: %.*s", (int)key.size(), key.data());
         }
 
         // ESP_LOGW("SolaxParameters", "******** key: %s", key.c_str());
@@ -123,7 +123,8 @@ public:
         ESP_LOGE("JSON", "EMPTY jsonMessage");
         return;
     }
-    cJSON *json = cJSON_Parse(jsonMessage.data());
+    // message is a view into the MQTT buffer, not terminated
+    cJSON *json = cJSON_ParseWithLength(jsonMessage.data(), jsonMessage.size());
     if (!json) {
         ESP_LOGE("JSON", "Failed to parse JSON: %s", cJSON_GetErrorPtr());
         return;
@@ -133,10 +134,9 @@ public:
     cJSON *name = cJSON_GetObjectItem(json, "name");
 
     if (cJSON_IsNumber(value) && cJSON_IsString(name)) {
-        std::string nameStr = name->valuestring;
         int32_t valueInt = static_cast<int32_t>(value->valuedouble); 
 
-        updateSolaxParameter(params, nameStr, valueInt);
+        updateSolaxParameter(params, name->valuestring, valueInt);
     } else {
         ESP_LOGW("JSON", "Invalid JSON structure");
     }
@@ -8,8 +8,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <variant>
+#include <utility>
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_log.h"
 #include <mutex>
 
 
@@ -138,7 +142,108 @@ public:
         return rc;
     }
 
+    /// @brief Batch of writes committed at once. Values equal to the stored ones
+    /// are skipped, so saving an unchanged form does not touch the flash at all.
+    ///
+    ///     auto tx = KeyVal::getInstance().begin();
+    ///     tx.writeString(literals::kv_ssid, ssid);
+    ///     tx.commit();
+    ///
+    /// Staged values not committed are discarded.
+    class Transaction
+    {
+    public:
+        void writeString(const std::string &key, const std::string &value)
+        {
+            _staged.emplace_back(key, value);
+        }
+
+        void writeUint32(const std::string &key, uint32_t value)
+        {
+            _staged.emplace_back(key, value);
+        }
+
+        /// @brief Writes changed values and commits once
+        /// @return true - success
+        bool commit()
+        {
+            bool rc = _kv.commitTransaction(_staged, _changed);
+            _staged.clear();
+            return rc;
+        }
+
+        /// @brief Number of values really written by the last commit
+        int changed() const { return _changed; }
+
+    private:
+        friend class KeyVal;
+        explicit Transaction(KeyVal &kv) : _kv(kv) {}
+
+        KeyVal &_kv;
+        std::vector<std::pair<std::string, std::variant<std::string, uint32_t>>> _staged;
+        int _changed{0};
+    };
+
+    Transaction begin() { return Transaction(*this); }
+
 private:
+    static constexpr const char *TAG = "KeyVal";
+
+    bool commitTransaction(const std::vector<std::pair<std::string, std::variant<std::string, uint32_t>>> &staged, int &changed)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        changed = 0;
+        esp_err_t err = ESP_OK;
+
+        for (const auto &[key, value] : staged)
+        {
+            if (const auto *str = std::get_if<std::string>(&value))
+            {
+                if (isStoredString(key, *str))
+                    continue;
+                err = nvs_set_str(_nvsHandle, key.c_str(), str->c_str());
+            }
+            else
+            {
+                uint32_t stored = 0;
+                uint32_t num = std::get<uint32_t>(value);
+                if (nvs_get_u32(_nvsHandle, key.c_str(), &stored) == ESP_OK && stored == num)
+                    continue;
+                err = nvs_set_u32(_nvsHandle, key.c_str(), num);
+            }
+
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Write %s failed: %s", key.c_str(), esp_err_to_name(err));
+                break;
+            }
+            changed++;
+        }
+
+        if (changed > 0)
+        {
+            esp_err_t cerr = nvs_commit(_nvsHandle);
+            if (err == ESP_OK)
+                err = cerr;
+        }
+
+        ESP_LOGI(TAG, "Transaction %u values, %d changed", (unsigned)staged.size(), changed);
+        return err == ESP_OK;
+    }
+
+    // caller holds the mutex
+    bool isStoredString(const std::string &key, const std::string &value) const
+    {
+        size_t size = 0;
+        if (nvs_get_str(_nvsHandle, key.c_str(), nullptr, &size) != ESP_OK || size != value.size() + 1)
+            return false;
+
+        std::string stored(size, '\0');
+        if (nvs_get_str(_nvsHandle, key.c_str(), stored.data(), &size) != ESP_OK)
+            return false;
+
+        return stored.compare(0, value.size(), value) == 0;
+    }
     
     KeyVal() : _isInitialized(false) {}
     nvs_handle_t _nvsHandle;
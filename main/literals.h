@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include <string_view>
+#include <cstdint>
 
 
 class literals
@@ -24,6 +25,7 @@ public:
     static constexpr const char *tsk_dspl{"DSPLTSK"};
     static constexpr const char *tsk_mqtt{"DSPLTSK"};
     static constexpr const char *tsk_time{"TIMETSK"};
+    static constexpr const char *tsk_storage{"STORTSK"};
 
     // AP definition
     static constexpr const char *ap_name{"PVVIEWAP"};
@@ -43,14 +45,73 @@ public:
     static constexpr const char *kv_topic{"topic"};
     static constexpr const char *kv_timezone{"timezone"};
     static constexpr const char *kv_timeserver{"timeserver"};
+    static constexpr const char *kv_ckpt{"ckpt"};                 // checkpoint interval in minutes, 0 - disabled
+    static constexpr const char *kv_pubtopic{"pubtopic"};         // prefix of published topics
+    static constexpr const char *kv_pubint{"pubint"};             // metrics publish interval in seconds, 0 - disabled
+    static constexpr const char *kv_obx_first{"obxfirst"};         // oldest outbox segment on the card
+    static constexpr const char *kv_obx_next{"obxnext"};           // next outbox segment number
+    static constexpr const char *kv_wifi_ap{"wifiap"};             // BSSID and channel of the last AP
+    static constexpr const char *kv_power{"pwrprof"};             // power profile (performance, balanced, saver)
     
     // spiffs filenames
     static constexpr const char *kv_fl_ap{"/spiffs/ap.html"};
     static constexpr const char *kv_fl_style{"/spiffs/style.css"}; 
     static constexpr const char *kv_fl_finish{"/spiffs/finish.html"};
     
+    // defaults
+    static constexpr const char *kv_def_ssid{"myAP"};
+    static constexpr const char *kv_def_mqtt{"192.168.1.20"};
+    static constexpr const char *kv_def_topic{"solax/data"};
+    static constexpr const char *kv_def_pubtopic{"pvview"};
+    static constexpr uint32_t kv_def_pubint{60};
+    static constexpr const char *kv_def_power{"balanced"};
+
     // time 
     static constexpr const char *kv_def_timezone{"CET-1CEST,M3.5.0,M10.5.0/3"};
     static constexpr const char *kv_def_timeserver{"cz.pool.ntp.org"};
 
+    // checkpoint of energy counters (dedicated NVS namespace)
+    static constexpr const char *ckpt_namespace{"pvckpt"};
+    static constexpr uint32_t ckpt_def_interval{15};             // minutes
+
+    // MQTT reassembly of fragmented messages (PSRAM buffers, allocated on first use)
+    static constexpr size_t mqtt_max_message{16 * 1024};           // larger messages are dropped
+    static constexpr size_t mqtt_fragment_buffers{2};
+
+    // reconnect backoff (exponential with jitter)
+    static constexpr uint32_t mqtt_connect_timeout_ms{15000};
+    static constexpr uint32_t mqtt_backoff_base_ms{1000};
+    static constexpr uint32_t mqtt_backoff_cap_ms{5 * 60 * 1000};
+    static constexpr uint32_t wifi_backoff_base_ms{1000};
+    static constexpr uint32_t wifi_backoff_cap_ms{2 * 60 * 1000};
+    static constexpr uint32_t sntp_backoff_base_ms{5000};
+    static constexpr uint32_t sntp_backoff_cap_ms{10 * 60 * 1000};
+
+    // WiFi link monitoring and roaming
+    static constexpr int wifi_roam_rssi{-70};                      // dBm, below it a better AP is searched
+    static constexpr int wifi_roam_hysteresis_db{8};               // the new AP must be this much stronger
+    static constexpr uint32_t wifi_roam_hold_ms{2 * 60 * 1000};    // shortest time between two roam checks
+    static constexpr uint32_t wifi_rssi_interval_ms{10000};        // RSSI sampling
+    static constexpr uint32_t wifi_stats_interval_ms{5 * 60 * 1000}; // link statistics report
+
+    // WiFi scan for the AP setup
+    static constexpr uint32_t wifi_scan_dwell_ms{120};             // active scan time per channel
+    static constexpr uint32_t wifi_scan_timeout_ms{10000};         // blocking scan() limit
+    static constexpr uint32_t wifi_scan_cache_ms{60000};           // cached results are used without a new scan
+
+    // outbound MQTT store-and-forward (PSRAM ring, overflow to SD card segments)
+    static constexpr size_t outbox_ring_size{32 * 1024};
+    static constexpr uint32_t outbox_max_segments{64};              // 2 MB on the card
+    static constexpr uint32_t outbox_window{4};                     // unconfirmed messages in flight
+
+    // power profiles
+    static constexpr int night_from_hour{22};                       // backlight off from (local time)
+    static constexpr int night_to_hour{6};                          // backlight on again
+    static constexpr uint32_t backlight_wake_ms{60000};             // touch turns the backlight on for
+    static constexpr uint32_t power_log_interval_ms{5 * 60 * 1000}; // current draw and latency report
+
+    // SD card
+    static constexpr const char *sd_mount{"/sdcard"};
+    static constexpr bool sd_benchmark{false};                    // log card throughput after mount
+
 };
\ No newline at end of file
@@ -0,0 +1,270 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   live_data.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <esp_http_server.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "ui_transfer.h"
+
+/// @brief Latest snapshot of the display data for the REST API and Server-Sent Events.
+///
+/// The producer (DisplayTask) serializes each snapshot once. All readers share that
+/// buffer: GET /api/now and /api/today copy it, SSE subscribers get the same
+/// pre-framed chunk. Subscriber sockets are touched only from the httpd task
+/// (handlers and httpd_queue_work), so only the buffers need the mutex.
+class LiveData
+{
+public:
+    static constexpr size_t maxSubscribers = 3;
+
+    LiveData()
+    {
+        _mutex = xSemaphoreCreateMutex();
+        _fds.fill(-1);
+    }
+
+    ~LiveData()
+    {
+        if (_mutex)
+            vSemaphoreDelete(_mutex);
+    }
+
+    LiveData(LiveData const &) = delete;
+    void operator=(LiveData const &) = delete;
+
+    /// @brief New snapshot (producer side)
+    /// @param pv photovoltaic energy per hour (Wh)
+    /// @param cons consumption per hour (Wh)
+    void update(const SolarData &sol, const float (&pv)[24], const float (&cons)[24], time_t now)
+    {
+        std::string jnow;
+        jnow.reserve(768);
+        append(jnow, "{\"time\":%lld,\"pv\":%.0f,\"dc1\":%.0f,\"dc2\":%.0f,\"load\":%.0f,\"feedin\":%.0f,"
+                     "\"gridR\":%.0f,\"gridS\":%.0f,\"gridT\":%.0f,\"free\":%.0f,"
+                     "\"battery\":{\"soc\":%d,\"power\":%.0f,\"temp\":%.1f},"
+                     "\"inverter\":{\"power\":%.0f,\"temp\":%.1f,\"mode\":%d,\"onGrid\":%s},"
+                     "\"outdoorTemp\":%.1f,\"hdo\":%s,\"wifiError\":%s,\"mqttError\":%s,",
+               static_cast<long long>(now), sol.photovoltaic, sol.powerDC1, sol.powerDC2, sol.consumption, sol.feedinPower,
+               sol.gridPowerR, sol.gridPowerS, sol.gridPowerT, sol.freeEnergy,
+               sol.batteryCapacity, sol.batteryChargePower, sol.batteryTemperature,
+               sol.inverterTotal, sol.invTemp, sol.mode, boolStr(sol.onGrid),
+               sol.outdoorTemp, boolStr(sol.hdo), boolStr(sol.errorWifi), boolStr(sol.errorMqtt));
+        append(jnow, "\"day\":");
+        kpi(jnow, sol.kpiDay);
+        append(jnow, ",\"month\":");
+        kpi(jnow, sol.kpiMonth);
+        append(jnow, "}");
+
+        std::string jtoday;
+        jtoday.reserve(512);
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+        append(jtoday, "{\"date\":\"%04d-%02d-%02d\",\"pv\":", tmNow.tm_year + 1900, tmNow.tm_mon + 1, tmNow.tm_mday);
+        series(jtoday, pv);
+        append(jtoday, ",\"cons\":");
+        series(jtoday, cons);
+        append(jtoday, ",\"kpi\":");
+        kpi(jtoday, sol.kpiDay);
+        append(jtoday, "}");
+
+        // complete HTTP chunk with SSE event, sent as it is to all subscribers
+        size_t payload = jnow.size() + 8; // "data: " + "\n\n"
+        std::string event;
+        event.reserve(jnow.size() + 24);
+        append(event, "%x\r\ndata: ", static_cast<unsigned>(payload));
+        event += jnow;
+        event += "\n\n\r\n";
+
+        if (xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE)
+        {
+            _now.swap(jnow);
+            _today.swap(jtoday);
+            _event.swap(event);
+            _version++;
+            xSemaphoreGive(_mutex);
+        }
+    }
+
+    uint32_t version() const { return _version; }
+
+    std::string now() const { return copy(_now); }
+    std::string today() const { return copy(_today); }
+
+    /// @brief Sends JSON copy of the buffer
+    esp_err_t sendNow(httpd_req_t *req) const { return sendJson(req, now()); }
+    esp_err_t sendToday(httpd_req_t *req) const { return sendJson(req, today()); }
+
+    /// @brief GET /api/events handler, keeps the socket open for pushes (httpd task)
+    esp_err_t subscribe(httpd_req_t *req)
+    {
+        int fd = httpd_req_to_sockfd(req);
+        size_t slot = 0;
+        while (slot < _fds.size() && _fds[slot] != -1)
+            slot++;
+
+        if (slot == _fds.size())
+        {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            return httpd_resp_send(req, "Too many subscribers", HTTPD_RESP_USE_STRLEN);
+        }
+
+        httpd_resp_set_type(req, "text/event-stream");
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        // first chunk sends the headers, the response is never terminated
+        if (httpd_resp_send_chunk(req, "retry: 5000\n\n", HTTPD_RESP_USE_STRLEN) != ESP_OK)
+            return ESP_FAIL;
+
+        // unsubscribe when httpd closes the session
+        req->sess_ctx = new Session{this, fd};
+        req->free_ctx = &LiveData::sessionClosed;
+
+        _fds[slot] = fd;
+        _subscribers++;
+        ESP_LOGI(TAG, "SSE subscriber fd %d", fd);
+
+        std::string event = copy(_event);
+        if (!event.empty())
+            httpd_socket_send(req->handle, fd, event.data(), event.size(), 0);
+        return ESP_OK;
+    }
+
+    /// @brief Schedules push of the current snapshot in the httpd task
+    void push(httpd_handle_t server)
+    {
+        if (!server || _subscribers == 0)
+            return;
+
+        auto *work = new Push{this, server};
+        if (httpd_queue_work(server, &LiveData::pushWork, work) != ESP_OK)
+            delete work;
+    }
+
+private:
+    static constexpr const char *TAG = "LiveData";
+
+    struct Session
+    {
+        LiveData *owner;
+        int fd;
+    };
+
+    struct Push
+    {
+        LiveData *owner;
+        httpd_handle_t server;
+    };
+
+    SemaphoreHandle_t _mutex{nullptr};
+    std::string _now;
+    std::string _today;
+    std::string _event;
+    std::atomic<uint32_t> _version{0};
+    std::array<int, maxSubscribers> _fds;
+    std::atomic<uint32_t> _subscribers{0};
+
+    static void sessionClosed(void *ctx)
+    {
+        auto *session = static_cast<Session *>(ctx);
+        session->owner->unsubscribe(session->fd);
+        delete session;
+    }
+
+    void unsubscribe(int fd)
+    {
+        for (auto &f : _fds)
+        {
+            if (f == fd)
+            {
+                f = -1;
+                _subscribers--;
+                ESP_LOGI(TAG, "SSE subscriber fd %d closed", fd);
+            }
+        }
+    }
+
+    static void pushWork(void *arg)
+    {
+        auto *push = static_cast<Push *>(arg);
+        LiveData *self = push->owner;
+        std::string event = self->copy(self->_event);
+
+        for (int fd : self->_fds)
+        {
+            if (fd == -1)
+                continue;
+
+            if (httpd_socket_send(push->server, fd, event.data(), event.size(), 0) < 0)
+            {
+                // session close calls sessionClosed
+                ESP_LOGW(TAG, "SSE send to fd %d failed", fd);
+                httpd_sess_trigger_close(push->server, fd);
+            }
+        }
+        delete push;
+    }
+
+    std::string copy(const std::string &src) const
+    {
+        std::string out;
+        if (xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE)
+        {
+            out = src;
+            xSemaphoreGive(_mutex);
+        }
+        return out;
+    }
+
+    static esp_err_t sendJson(httpd_req_t *req, const std::string &json)
+    {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        if (json.empty())
+            return httpd_resp_send(req, "{}", 2);
+        return httpd_resp_send(req, json.data(), json.size());
+    }
+
+    static const char *boolStr(bool b) { return b ? "true" : "false"; }
+
+    static void kpi(std::string &out, const EnergyKpi &k)
+    {
+        append(out, "{\"pvWh\":%.0f,\"loadWh\":%.0f,\"importWh\":%.0f,\"exportWh\":%.0f,\"battChargeWh\":%.0f,"
+                    "\"battDischargeWh\":%.0f,\"peakPv\":%.0f,\"peakLoad\":%.0f,\"cycles\":%.2f,\"autarky\":%.1f,\"selfConsumption\":%.1f}",
+               k.pvWh, k.loadWh, k.importWh, k.exportWh, k.battChargeWh,
+               k.battDischargeWh, k.peakPv, k.peakLoad, k.cycles, k.autarky(), k.selfConsumption());
+    }
+
+    static void series(std::string &out, const float (&values)[24])
+    {
+        out += '[';
+        for (int h = 0; h < 24; h++)
+        {
+            append(out, h ? ",%.1f" : "%.1f", values[h]);
+        }
+        out += ']';
+    }
+
+    __attribute__((format(printf, 2, 3))) static void append(std::string &out, const char *fmt, ...)
+    {
+        char buf[640];
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (n > 0)
+            out.append(buf, std::min<size_t>(n, sizeof(buf) - 1));
+    }
+};
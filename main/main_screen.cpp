@@ -144,8 +144,7 @@ void MainScreen::enableOverviewClick()
                 MainScreen *dashboard = static_cast<MainScreen *>(lv_event_get_user_data(e));
                 if (!ScreenManager::getInstance()->showScreenByType(ScreenType::Setting))
                 {
-                    Application::getInstance()->getWifiTask()->switchMode(WifiTask::Mode::Stop);
-
+                    // STA stays connected, the setting screen scans next to it
                     ScreenManager::getInstance()->addScreen(std::make_unique<SettingScreen>());
                     ScreenManager::getInstance()->showScreenByType(ScreenType::Setting);
                 } }, LV_EVENT_CLICKED, this);
@@ -229,7 +228,16 @@ void MainScreen::createBarGraph(int frameOverviewWidth, int frameOverviewHeight,
 
     _temperatureOut = UI::addLabel(_barGraphFrame, "--", LV_ALIGN_TOP_MID, 0, 60, &lv_font_montserrat_40);
 
+    // --------- Create analytics
+    _statsLabel = UI::addLabel(_barGraphFrame, "--", LV_ALIGN_TOP_LEFT, -5, -10, &lv_font_montserrat_14);
+    lv_obj_add_flag(_statsLabel, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(_statsLabel, [](lv_event_t *e)
+                        {
+                MainScreen *dashboard = static_cast<MainScreen *>(lv_event_get_user_data(e));
+        dashboard->onChartClick(); }, LV_EVENT_CLICKED, this);
+
     graphDisplay(false);
+    statsDisplay(false);
 }
 
 void MainScreen::graphDisplay(bool hideGraph)
@@ -258,6 +266,29 @@ void MainScreen::graphDisplay(bool hideGraph)
     }
 }
 
+void MainScreen::statsDisplay(bool show)
+{
+    if (!_statsLabel)
+        return;
+
+    if (show)
+    {
+        lv_obj_add_flag(_chartTitleLabel, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_chart, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_maxLabel, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_totalSolLabel, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_dayConsumpLabel, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_totalSol, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_totalCons, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_add_flag(_temperatureOut, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(_statsLabel, LV_OBJ_FLAG_HIDDEN);
+    }
+    else
+    {
+        lv_obj_add_flag(_statsLabel, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
 void MainScreen::onChartClick()
 {
     ESP_LOGI(TAG, "onChartClick called");
@@ -274,7 +305,7 @@ void MainScreen::onChartClick()
         return;
     }
 
-    _currentDataSetIndex = (_currentDataSetIndex + 1) % 3;
+    _currentDataSetIndex = (_currentDataSetIndex + 1) % _pageCount;
     updateChart();
 
     ESP_LOGI(TAG, "onChartClick: %d\n", _currentDataSetIndex);
@@ -288,6 +319,10 @@ void MainScreen::updateChartRange()
         return;
     }
 
+    // text pages have no data set
+    if (_currentDataSetIndex >= 2)
+        return;
+
     int minValue = 0;
     int maxValue = 0;
 
@@ -320,12 +355,18 @@ void MainScreen::updateChartRange()
 
 void MainScreen::updateChart()
 {
-    if (_currentDataSetIndex == 2)
+    if (_currentDataSetIndex == 3)
     {
+        statsDisplay(true);
+    }
+    else if (_currentDataSetIndex == 2)
+    {
+        statsDisplay(false);
         graphDisplay(true);
     }
     else
     {
+        statsDisplay(false);
         graphDisplay(false);
         lv_label_set_text(_chartTitleLabel, _dataSets[_currentDataSetIndex].description);
         lv_chart_set_series_color(_chart, _chartSeries, _dataSets[_currentDataSetIndex].color);
@@ -693,6 +734,9 @@ void MainScreen::solaxUpdate(const SolarData &sol)
     if (_totalSolLabel)  lv_label_set_text(_totalSolLabel, Utils::formatPower(sol.sol , "W", "h").c_str());
     if (_dayConsumpLabel) lv_label_set_text(_dayConsumpLabel, Utils::formatPower(sol.cons, "W", "h").c_str());   
 
+    // Analytics
+    updateStats(sol);
+
     if (sol.errorMqtt || sol.errorWifi) 
     {
         if (sol.errorWifi)  setNowWifi();
@@ -736,6 +780,31 @@ void MainScreen::solaxUpdate(const SolarData &sol)
     }
 
 
+void MainScreen::updateStats(const SolarData &sol)
+{
+    if (!_statsLabel)
+        return;
+
+    auto period = [](std::string &out, const char *title, const EnergyKpi &k)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "%s  autarky %.0f %%  self %.0f %%\n", title, k.autarky(), k.selfConsumption());
+        out += line;
+        out += " PV " + Utils::formatPower(k.pvWh, "W", "h");
+        out += "  load " + Utils::formatPower(k.loadWh, "W", "h") + "\n";
+        out += " peak PV " + Utils::formatPower(k.peakPv);
+        out += "  load " + Utils::formatPower(k.peakLoad) + "\n";
+        snprintf(line, sizeof(line), "  cycles %.2f\n", k.cycles);
+        out += " battery " + Utils::formatPower(k.battDischargeWh, "W", "h") + line;
+    };
+
+    std::string txt;
+    txt.reserve(256);
+    period(txt, "Today", sol.kpiDay);
+    period(txt, "Month", sol.kpiMonth);
+    lv_label_set_text(_statsLabel, txt.c_str());
+}
+
  void MainScreen::updateTemperatureTextColor(lv_obj_t *label, float temp)
     {
         if (temp < 15)
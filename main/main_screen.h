@@ -64,9 +64,11 @@ private:
     lv_obj_t *_totalSol{nullptr};
     lv_obj_t *_dayConsumpLabel{nullptr};
     lv_obj_t *_totalCons{nullptr};
-    int _currentDataSetIndex{0};
+    int _currentDataSetIndex{0};           ///< 0,1 - charts, 2 - totals, 3 - analytics
+    static constexpr int _pageCount = 4;
 
     lv_obj_t *_temperatureOut{nullptr};
+    lv_obj_t *_statsLabel{nullptr};
 
     lv_obj_t *_messageIcon{nullptr};
     lv_obj_t *_messageLabel{nullptr};
@@ -109,6 +111,8 @@ private:
     void createBarGraph(int frameOverviewWidth, int frameOverviewHeight, int top, const char *title, lv_color_t barColor);
     void onChartClick();
     void graphDisplay(bool hideGraph);
+    void statsDisplay(bool show);
+    void updateStats(const SolarData &sol);
     void updateChart();
     void updateChartRange();
     void enableOverviewClick();
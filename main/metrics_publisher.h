@@ -0,0 +1,155 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   metrics_publisher.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "esp_log.h"
+#include "ui_transfer.h"
+
+/// @brief Publishes the values derived by the display back to MQTT.
+///
+/// Samples are averaged and sent as one JSON batch per interval to <prefix>/metrics,
+/// so the broker sees one message per interval regardless of the input rate.
+/// When the hour changes, the energy of the finished hour is published retained to
+/// <prefix>/energy/hour, a late subscriber gets the last summary immediately.
+/// Used only from the display task.
+class MetricsPublisher
+{
+public:
+    /// @brief Sink of the messages, e.g. MqttTask::publish
+    using PublishFn = std::function<bool(std::string_view topic, std::string payload, int qos, bool retain)>;
+
+    MetricsPublisher() = default;
+
+    /// @param prefix topic prefix
+    /// @param intervalSec batch interval, 0 - publishing disabled
+    void configure(std::string_view prefix, uint32_t intervalSec)
+    {
+        _prefix = prefix;
+        _intervalSec = intervalSec;
+        _lastPublish = 0;
+        reset();
+        ESP_LOGI(TAG, "Prefix [%s] interval %lu s", _prefix.c_str(), static_cast<unsigned long>(_intervalSec));
+    }
+
+    bool enabled() const { return _intervalSec > 0 && !_prefix.empty(); }
+
+    /// @brief Add one sample to the running averages
+    void sample(const SolarData &sol)
+    {
+        if (!enabled())
+            return;
+
+        _sum.pv += sol.photovoltaic;
+        _sum.load += sol.consumption;
+        _sum.feedin += sol.feedinPower;
+        _sum.battery += sol.batteryChargePower;
+        _sum.grid += sol.inverterTotal;
+        _samples++;
+    }
+
+    /// @brief Publishes the batch when the interval elapsed and the hour summary on hour change
+    /// @param now synchronized wall clock time
+    /// @param pv photovoltaic energy per hour (Wh)
+    /// @param cons consumption per hour (Wh)
+    void tick(time_t now, const SolarData &sol, const float (&pv)[24], const float (&cons)[24], const PublishFn &publish)
+    {
+        if (!enabled() || !publish)
+            return;
+
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+
+        if (_hour >= 0 && _hour != tmNow.tm_hour)
+            publishHour(publish);
+
+        // values of the running hour, at midnight the counters are already reset
+        _hour = tmNow.tm_hour;
+        _hourPv = pv[_hour];
+        _hourLoad = cons[_hour];
+        strftime(_hourDate, sizeof(_hourDate), "%Y-%m-%d", &tmNow);
+
+        if (_lastPublish == 0)
+            _lastPublish = now;
+        if (_samples == 0 || now - _lastPublish < static_cast<time_t>(_intervalSec))
+            return;
+
+        std::string json;
+        json.reserve(384);
+        const float n = static_cast<float>(_samples);
+        append(json, "{\"time\":%lld,\"interval\":%lu,\"samples\":%lu,"
+                     "\"pv\":%.0f,\"load\":%.0f,\"feedin\":%.0f,\"battery\":%.0f,\"grid\":%.0f,\"soc\":%d,"
+                     "\"day\":{\"pvWh\":%.0f,\"loadWh\":%.0f,\"importWh\":%.0f,\"exportWh\":%.0f,\"selfConsumption\":%.1f,\"autarky\":%.1f}}",
+               static_cast<long long>(now), static_cast<unsigned long>(now - _lastPublish), static_cast<unsigned long>(_samples),
+               _sum.pv / n, _sum.load / n, _sum.feedin / n, _sum.battery / n, _sum.grid / n, sol.batteryCapacity,
+               sol.kpiDay.pvWh, sol.kpiDay.loadWh, sol.kpiDay.importWh, sol.kpiDay.exportWh,
+               sol.kpiDay.selfConsumption(), sol.kpiDay.autarky());
+
+        if (!publish(_prefix + "/metrics", std::move(json), 0, false))
+            ESP_LOGW(TAG, "Metrics not queued");
+
+        _lastPublish = now;
+        reset();
+    }
+
+private:
+    static constexpr const char *TAG = "MetricsPublisher";
+
+    struct Sum
+    {
+        float pv{0};
+        float load{0};
+        float feedin{0};
+        float battery{0};
+        float grid{0};
+    };
+
+    void reset()
+    {
+        _sum = Sum{};
+        _samples = 0;
+    }
+
+    void publishHour(const PublishFn &publish)
+    {
+        std::string json;
+        append(json, "{\"date\":\"%s\",\"hour\":%d,\"pvWh\":%.1f,\"loadWh\":%.1f}", _hourDate, _hour, _hourPv, _hourLoad);
+
+        // QoS 1 retained, the summary must not be lost between two hours
+        if (!publish(_prefix + "/energy/hour", std::move(json), 1, true))
+            ESP_LOGW(TAG, "Hour %d summary not queued", _hour);
+    }
+
+    __attribute__((format(printf, 2, 3))) static void append(std::string &out, const char *fmt, ...)
+    {
+        char buf[384];
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (n > 0)
+            out.append(buf, std::min<size_t>(n, sizeof(buf) - 1));
+    }
+
+    std::string _prefix;
+    uint32_t _intervalSec{0};
+    time_t _lastPublish{0};
+    Sum _sum{};
+    uint32_t _samples{0};
+
+    int _hour{-1}; ///< hour of the cached values, -1 - none yet
+    float _hourPv{0};
+    float _hourLoad{0};
+    char _hourDate[11]{};
+};
@@ -14,12 +14,27 @@
 #include <mqtt_client.h>
 #include <string>
 #include <string_view>
-#include <map>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "topic_trie.h"
+#include "mqtt_assembler.h"
 
 using MqttConnectedCallback = std::function<void()>;
 using MqttDisconnectedCallback = std::function<void()>;
 using MqttMessageCallback = std::function<void(std::string_view topic, std::string_view message)>;
-
+using MqttPublishedCallback = std::function<void(int msgId)>;
+
+/// @brief esp-mqtt client wrapper.
+/// The esp-mqtt event task never waits for application locks: the connection state
+/// is atomic and messages are routed through an immutable trie published by a plain
+/// atomic pointer (RCU). Subscribe and unsubscribe (serialized by _connectionMutex)
+/// build a new trie and swap the pointer; the old trie is freed once no dispatch is
+/// running, otherwise it is retired and freed by a later update.
+/// _connectionMutex is never held while calling esp-mqtt (its API lock is held by the
+/// event task during the callbacks), so message callbacks may subscribe/unsubscribe.
+/// The automatic reconnect of esp-mqtt is disabled, the owner decides when to
+/// reconnect() (backoff), subscriptions are kept and sent again by resubscribe().
 class Mqtt
 {
 public:
@@ -44,6 +59,11 @@ public:
             _client = nullptr;
         }
 
+        // no dispatch after the client is destroyed
+        delete _routes.exchange(nullptr);
+        for (const Routes *r : _retired)
+            delete r;
+
         if (_connectionMutex)
         {
             vSemaphoreDelete(_connectionMutex);
@@ -51,7 +71,8 @@ public:
         }
     }
 
-    bool init(std::string_view uri, std::string_view username = "", std::string_view password = "")
+    /// @param keepaliveSec 0 - esp-mqtt default (120 s)
+    bool init(std::string_view uri, std::string_view username = "", std::string_view password = "", int keepaliveSec = 0)
     {
         if (uri.empty())
         {
@@ -65,38 +86,87 @@ public:
             return false;
         }
 
-        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) == pdTRUE)
+        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) != pdTRUE)
+            return false;
+
+        if (_client)
         {
-            if (_client)
-            {
-                ESP_LOGE(LOG_TAG, "MQTT is already initialized");
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
+            ESP_LOGE(LOG_TAG, "MQTT is already initialized");
+            xSemaphoreGive(_connectionMutex);
+            return false;
+        }
 
-            esp_mqtt_client_config_t mqtt_cfg = {};
-            mqtt_cfg.broker.address.uri = uri.data();
-            mqtt_cfg.credentials.username = username.empty() ? nullptr : username.data();
-            mqtt_cfg.credentials.authentication.password = password.empty() ? nullptr : password.data();
+        esp_mqtt_client_config_t mqtt_cfg = {};
+        mqtt_cfg.broker.address.uri = uri.data();
+        mqtt_cfg.credentials.username = username.empty() ? nullptr : username.data();
+        mqtt_cfg.credentials.authentication.password = password.empty() ? nullptr : password.data();
+        mqtt_cfg.network.disable_auto_reconnect = true;
+        if (keepaliveSec > 0)
+            mqtt_cfg.session.keepalive = keepaliveSec;
 
-            _client = esp_mqtt_client_init(&mqtt_cfg);
-            if (!_client)
-            {
-                ESP_LOGE(LOG_TAG, "Failed to initialize MQTT client");
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
+        _client = esp_mqtt_client_init(&mqtt_cfg);
+        _isConnected = false; // MQTT_EVENT_CONNECTED follows
+        xSemaphoreGive(_connectionMutex);
 
-            esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, &Mqtt::mqttEventHandler, this);
-            esp_err_t ret = esp_mqtt_client_start(_client);
-            _isConnected = (ret == ESP_OK);
+        if (!_client)
+        {
+            ESP_LOGE(LOG_TAG, "Failed to initialize MQTT client");
+            return false;
+        }
 
-            ESP_LOGI(LOG_TAG, "MQTT %s", _isConnected ? "started successfully" : "failed to start");
-            xSemaphoreGive(_connectionMutex);
+        // API lock of the new client, outside _connectionMutex
+        esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, &Mqtt::mqttEventHandler, this);
+        esp_err_t ret = esp_mqtt_client_start(_client);
+
+        ESP_LOGI(LOG_TAG, "MQTT %s", ret == ESP_OK ? "started successfully" : "failed to start");
+        return ret == ESP_OK;
+    }
 
-            return _isConnected;
+    /// @brief New connection attempt of the existing client
+    bool reconnect()
+    {
+        if (!_client)
+            return false;
+
+        esp_err_t ret = esp_mqtt_client_reconnect(_client);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGW(LOG_TAG, "Reconnect failed: %s", esp_err_to_name(ret));
+            return false;
         }
-        return false;
+        return true;
+    }
+
+    /// @brief Drops the connection at once (link lost), the client waits for reconnect()
+    void disconnect()
+    {
+        if (_client)
+            esp_mqtt_client_disconnect(_client);
+    }
+
+    /// @brief Sends SUBSCRIBE for all registered filters (after a new connection)
+    /// @return false - some filter was not sent
+    bool resubscribe()
+    {
+        std::vector<std::string> filters;
+        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) != pdTRUE)
+            return false;
+        filters.reserve(_subscriptions.size());
+        for (const auto &s : _subscriptions)
+            filters.push_back(s.first);
+        xSemaphoreGive(_connectionMutex);
+
+        bool ok = true;
+        for (const auto &filter : filters)
+        {
+            if (esp_mqtt_client_subscribe(_client, filter.c_str(), 1) == -1)
+            {
+                ESP_LOGE(LOG_TAG, "Failed to subscribe to topic: %s", filter.c_str());
+                ok = false;
+            }
+        }
+        ESP_LOGI(LOG_TAG, "Resubscribed %u topics", (unsigned)filters.size());
+        return ok;
     }
 
     void registerConnectedCallback(MqttConnectedCallback callback)
@@ -109,73 +179,77 @@ public:
         _disconnectedCallback = callback;
     }
 
+    /// @brief Broker confirmed QoS 1/2 message (called from the esp-mqtt task).
+    /// esp-mqtt may report ids of its own resends or of a previous session, unknown ids are expected.
+    void registerPublishedCallback(MqttPublishedCallback callback)
+    {
+        _publishedCallback = callback;
+    }
+
     bool isConnected() const
     {
-        bool connected = false;
-        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) == pdTRUE)
-        {
-            connected = _isConnected;
-            xSemaphoreGive(_connectionMutex);
-        }
-        return connected;
+        return _isConnected.load(std::memory_order_acquire);
     }
 
-    bool publish(std::string_view topic, std::string_view data, int qos = 1, int retain = 0)
+    /// @return message id reported back by the published callback (0 for QoS 0), -1 - not sent
+    int publish(std::string_view topic, std::string_view data, int qos = 1, int retain = 0)
     {
         if (topic.empty() || data.empty())
         {
             ESP_LOGW(LOG_TAG, "topic / data is empty");
-            return false;
+            return -1;
         }
 
         if (!isConnected())
         {
             ESP_LOGW(LOG_TAG, "Cannot publish, MQTT is not connected");
-            return false;
+            return -1;
         }
 
-        int msg_id = esp_mqtt_client_publish(_client, topic.data(), data.data(), 0, qos, retain);
+        // topic must be NUL terminated, data length is explicit
+        int msg_id = esp_mqtt_client_publish(_client, topic.data(), data.data(), data.size(), qos, retain);
         if (msg_id == -1)
         {
             ESP_LOGE(LOG_TAG, "Failed to publish message");
-            return false;
+            return -1;
         }
 
         ESP_LOGI(LOG_TAG, "Published message with ID %d on topic %s", msg_id, topic.data());
-        return true;
+        return msg_id;
     }
 
+    /// @brief Subscribe topic filter, + and # wildcards are routed by the topic trie.
+    /// Offline the filter is only registered, resubscribe() sends it after connecting.
     bool subscribe(const std::string &topic, MqttMessageCallback callback)
     {
-        if (topic.empty())
+        if (!TopicTrie<MqttMessageCallback>::isValidFilter(topic))
         {
-            ESP_LOGE(LOG_TAG, "Topic cannot be empty");
+            ESP_LOGE(LOG_TAG, "Invalid topic filter [%s]", topic.c_str());
             return false;
         }
 
-        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) == pdTRUE)
-        {
-            if (!_isConnected)
-            {
-                ESP_LOGE(LOG_TAG, "MQTT is not connected");
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
-
-            int msg_id = esp_mqtt_client_subscribe(_client, topic.c_str(), 1);
-            if (msg_id == -1)
-            {
-                ESP_LOGE(LOG_TAG, "Failed to subscribe to topic: %s", topic.c_str());
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
+        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) != pdTRUE)
+            return false;
 
-            _topicCallbacks[topic] = callback; // Register the callback
-            ESP_LOGI(LOG_TAG, "Subscribed to topic: %s", topic.c_str());
-            xSemaphoreGive(_connectionMutex);
-            return true;
+        // route first, so the retained message that follows SUBSCRIBE has a target
+        auto it = std::find_if(_subscriptions.begin(), _subscriptions.end(), [&topic](const auto &s)
+                               { return s.first == topic; });
+        if (it != _subscriptions.end())
+            it->second = std::move(callback);
+        else
+            _subscriptions.emplace_back(topic, std::move(callback));
+        publishRoutes();
+        xSemaphoreGive(_connectionMutex);
+
+        // offline the filter is sent by resubscribe()
+        if (_isConnected && esp_mqtt_client_subscribe(_client, topic.c_str(), 1) == -1)
+        {
+            ESP_LOGE(LOG_TAG, "Failed to subscribe to topic: %s", topic.c_str());
+            return false;
         }
-        return false;
+
+        ESP_LOGI(LOG_TAG, "Subscribed to topic: %s", topic.c_str());
+        return true;
     }
 
     bool unsubscribe(const std::string &topic)
@@ -186,37 +260,57 @@ public:
             return false;
         }
 
-        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) == pdTRUE)
+        if (xSemaphoreTake(_connectionMutex, portMAX_DELAY) != pdTRUE)
+            return false;
+
+        // Remove the callback first, new messages are not routed to it
+        auto it = std::find_if(_subscriptions.begin(), _subscriptions.end(), [&topic](const auto &s)
+                               { return s.first == topic; });
+        if (it == _subscriptions.end())
         {
-            // Check if the topic is registered
-            auto it = _topicCallbacks.find(topic);
-            if (it == _topicCallbacks.end())
-            {
-                ESP_LOGW(LOG_TAG, "Topic %s is not registered", topic.c_str());
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
+            ESP_LOGW(LOG_TAG, "Topic %s is not registered", topic.c_str());
+            xSemaphoreGive(_connectionMutex);
+            return false;
+        }
+        _subscriptions.erase(it);
+        publishRoutes();
+        xSemaphoreGive(_connectionMutex);
 
-            // Unsubscribe from the topic
-            int msg_id = esp_mqtt_client_unsubscribe(_client, topic.c_str());
-            if (msg_id == -1)
-            {
-                ESP_LOGE(LOG_TAG, "Failed to unsubscribe from topic: %s", topic.c_str());
-                xSemaphoreGive(_connectionMutex);
-                return false;
-            }
+        // Unsubscribe from the topic, offline the broker forgets it anyway (clean session)
+        if (_isConnected && esp_mqtt_client_unsubscribe(_client, topic.c_str()) == -1)
+        {
+            ESP_LOGE(LOG_TAG, "Failed to unsubscribe from topic: %s", topic.c_str());
+            return false;
+        }
 
-            // Remove the topic from the callback map
-            _topicCallbacks.erase(it);
+        ESP_LOGI(LOG_TAG, "Unsubscribed from topic: %s", topic.c_str());
+        return true;
+    }
 
-            ESP_LOGI(LOG_TAG, "Unsubscribed from topic: %s", topic.c_str());
-            xSemaphoreGive(_connectionMutex);
-            return true;
+private:
+    using Routes = TopicTrie<MqttMessageCallback>;
+    static_assert(std::atomic<const Routes *>::is_always_lock_free, "route pointer must be lock-free");
+
+    /// @brief Builds a new trie from the subscriptions and swaps it in (caller holds _connectionMutex)
+    void publishRoutes()
+    {
+        auto *routes = new Routes();
+        for (const auto &[filter, callback] : _subscriptions)
+            routes->insert(filter, callback);
+
+        // seq_cst: a dispatch entered after the swap sees the new trie, a dispatch that
+        // may still hold the old one is visible in _dispatching
+        const Routes *old = _routes.exchange(routes);
+        if (old)
+            _retired.push_back(old);
+        if (_dispatching.load() == 0)
+        {
+            for (const Routes *r : _retired)
+                delete r;
+            _retired.clear();
         }
-        return false;
     }
 
-private:
     static void mqttEventHandler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
     {
 
@@ -226,11 +320,7 @@ private:
         {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(LOG_TAG, "MQTT Connected");
-            if (xSemaphoreTake(client->_connectionMutex, portMAX_DELAY) == pdTRUE)
-            {
-                client->_isConnected = true;
-                xSemaphoreGive(client->_connectionMutex);
-            }
+            client->_isConnected.store(true, std::memory_order_release);
             if (client->_connectedCallback)
             {
                 client->_connectedCallback();
@@ -239,11 +329,7 @@ private:
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(LOG_TAG, "MQTT Disconnected");
-            if (xSemaphoreTake(client->_connectionMutex, portMAX_DELAY) == pdTRUE)
-            {
-                client->_isConnected = false;
-                xSemaphoreGive(client->_connectionMutex);
-            }
+            client->_isConnected.store(false, std::memory_order_release);
             if (client->_disconnectedCallback)
             {
                 client->_disconnectedCallback();
@@ -252,6 +338,10 @@ private:
 
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(LOG_TAG, "Message published successfully");
+            if (client->_publishedCallback)
+            {
+                client->_publishedCallback(event->msg_id);
+            }
             break;
 
         case MQTT_EVENT_ERROR:
@@ -260,16 +350,21 @@ private:
 
         case MQTT_EVENT_DATA:
         {
-            std::string topic(event->topic, event->topic_len);
-            std::string message(event->data, event->data_len);
-
-            // ESP_LOGI(LOG_TAG, "Received data on topic: %s", topic.c_str());
-
-            auto it = client->_topicCallbacks.find(topic);
-            if (it != client->_topicCallbacks.end() && it->second)
+            // views over the esp-mqtt buffer or the reassembly block, valid only during the callback
+            std::string_view topic;
+            std::string_view message;
+            if (!client->_assembler.feed(*event, topic, message))
+                break;
+
+            // the trie stays alive until the dispatch ends, even if it is replaced meanwhile
+            client->_dispatching.fetch_add(1);
+            const Routes *routes = client->_routes.load();
+            if (!routes || routes->match(topic, [&](const MqttMessageCallback &callback)
+                                      { callback(topic, message); }) == 0)
             {
-                it->second(topic, message); // Invoke the callback
+                ESP_LOGW(LOG_TAG, "No route for %.*s", (int)topic.size(), topic.data());
             }
+            client->_dispatching.fetch_sub(1);
             break;
         }
 
@@ -278,10 +373,15 @@ private:
         }
     }
 
-    bool _isConnected;
+    std::atomic<bool> _isConnected;
     esp_mqtt_client_handle_t _client{nullptr};
     SemaphoreHandle_t _connectionMutex;
     MqttConnectedCallback _connectedCallback{};
     MqttDisconnectedCallback _disconnectedCallback{};
-    std::map<std::string, MqttMessageCallback> _topicCallbacks;
+    MqttPublishedCallback _publishedCallback{};
+    std::vector<std::pair<std::string, MqttMessageCallback>> _subscriptions; ///< writer side, under _connectionMutex
+    std::vector<const Routes *> _retired;                                   ///< replaced tries, under _connectionMutex
+    std::atomic<const Routes *> _routes{nullptr};                           ///< reader side, immutable trie
+    std::atomic<int> _dispatching{0};                                       ///< dispatches in progress
+    MqttAssembler _assembler;
 };
@@ -0,0 +1,194 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   mqtt_assembler.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstring>
+#include <array>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <mqtt_client.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "literals.h"
+
+/// @brief Fixed pool of reassembly buffers. Blocks are allocated in PSRAM on first
+/// use and never freed, so a recreated MQTT client reuses them and the heap does
+/// not fragment with large messages.
+class FragmentPool
+{
+public:
+    static constexpr size_t blockSize = literals::mqtt_max_message;
+
+    static FragmentPool &getInstance()
+    {
+        static FragmentPool instance;
+        return instance;
+    }
+
+    FragmentPool(FragmentPool const &) = delete;
+    void operator=(FragmentPool const &) = delete;
+
+    /// @return nullptr - all blocks in use or no memory
+    uint8_t *acquire()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _blocks.size(); i++)
+        {
+            if (_used[i])
+                continue;
+
+            if (!_blocks[i])
+            {
+                _blocks[i] = static_cast<uint8_t *>(heap_caps_malloc(blockSize, MALLOC_CAP_SPIRAM));
+                if (!_blocks[i])
+                    return nullptr;
+            }
+            _used[i] = true;
+            return _blocks[i];
+        }
+        return nullptr;
+    }
+
+    void release(uint8_t *block)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _blocks.size(); i++)
+        {
+            if (_blocks[i] == block)
+                _used[i] = false;
+        }
+    }
+
+private:
+    FragmentPool() = default;
+
+    std::mutex _mutex;
+    std::array<uint8_t *, literals::mqtt_fragment_buffers> _blocks{};
+    std::array<bool, literals::mqtt_fragment_buffers> _used{};
+};
+
+/// @brief Joins MQTT_EVENT_DATA fragments into complete messages.
+/// esp-mqtt delivers a payload larger than its buffer in several events, only the
+/// first one carries the topic. Fragments of one message come in order from the
+/// MQTT task, so one message is assembled at a time. A message that fits into one
+/// event is passed through without copying.
+class MqttAssembler
+{
+public:
+    MqttAssembler() = default;
+
+    ~MqttAssembler()
+    {
+        _complete = true;
+        release();
+    }
+
+    MqttAssembler(MqttAssembler const &) = delete;
+    void operator=(MqttAssembler const &) = delete;
+
+    /// @brief Consume one data event
+    /// @return true - message complete, topic and payload are valid until the next feed()
+    bool feed(const esp_mqtt_event_t &event, std::string_view &topic, std::string_view &payload)
+    {
+        release();
+
+        if (event.current_data_offset == 0)
+        {
+            if (_block)
+                drop("incomplete, next message started");
+
+            if (event.data_len == event.total_data_len)
+            {
+                topic = std::string_view(event.topic, event.topic_len);
+                payload = std::string_view(event.data, event.data_len);
+                return true;
+            }
+            return start(event);
+        }
+
+        if (!_block || event.current_data_offset != static_cast<int>(_received) ||
+            _received + event.data_len > _total)
+        {
+            // start of the message was dropped or a fragment is missing
+            if (_block)
+                drop("out of order fragment");
+            return false;
+        }
+
+        memcpy(_block + _received, event.data, event.data_len);
+        _received += event.data_len;
+        if (_received < _total)
+            return false;
+
+        topic = _topic;
+        payload = std::string_view(reinterpret_cast<const char *>(_block), _total);
+        _complete = true;
+        _assembled++;
+        return true;
+    }
+
+    /// @brief Number of messages joined from fragments / dropped
+    uint32_t assembled() const { return _assembled; }
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    static constexpr const char *TAG = "MqttAssembler";
+
+    bool start(const esp_mqtt_event_t &event)
+    {
+        if (static_cast<size_t>(event.total_data_len) > FragmentPool::blockSize)
+        {
+            _dropped++;
+            ESP_LOGW(TAG, "Message %d B over %u B dropped", event.total_data_len, (unsigned)FragmentPool::blockSize);
+            return false;
+        }
+
+        _block = FragmentPool::getInstance().acquire();
+        if (!_block)
+        {
+            _dropped++;
+            ESP_LOGW(TAG, "No reassembly buffer, message %d B dropped", event.total_data_len);
+            return false;
+        }
+
+        _topic.assign(event.topic, event.topic_len);
+        _total = event.total_data_len;
+        memcpy(_block, event.data, event.data_len);
+        _received = event.data_len;
+        return false;
+    }
+
+    void drop(const char *reason)
+    {
+        _dropped++;
+        ESP_LOGW(TAG, "Message %u B dropped: %s", (unsigned)_total, reason);
+        _complete = true;
+        release();
+    }
+
+    /// @brief Returns the block after a delivered or dropped message
+    void release()
+    {
+        if (_block && _complete)
+        {
+            FragmentPool::getInstance().release(_block);
+            _block = nullptr;
+            _received = _total = 0;
+        }
+        _complete = false;
+    }
+
+    uint8_t *_block{nullptr};
+    std::string _topic;
+    size_t _total{0};
+    size_t _received{0};
+    bool _complete{false};
+    uint32_t _assembled{0};
+    uint32_t _dropped{0};
+};
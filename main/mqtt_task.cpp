@@ -17,9 +17,12 @@
 #include "literals.h"
 #include "application.h"
 #include "json_serializer.h"
-#include "key_val.h"
+#include "config.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cstring>
 
-MqttTask::MqttTask() : _mqttClient(nullptr), _mqttInitialized(false)
+MqttTask::MqttTask() : _mqttClient(nullptr)
 {
 }
 
@@ -28,6 +31,11 @@ bool MqttTask::init(std::shared_ptr<ConnectionManager> connMgr,
 {
     bool rc = false;
     _connectionManager = connMgr;
+    // storage task is started before, the card may be mounted later
+    if (!_outbox.init(Application::getInstance()->getStorageTask()))
+    {
+        ESP_LOGE(LOG_TAG, "Outbox not available, messages are not published");
+    }
     rc = RPTask::init(name, priority, stackDepth);
     return rc;
 }
@@ -37,31 +45,97 @@ MqttTask::~MqttTask()
     done();
 }
 
+bool MqttTask::publish(std::string_view topic, std::string payload, int qos, bool retain)
+{
+    if (!_outbox.push(topic, payload, qos, retain))
+        return false;
+    if (task())
+        xTaskNotifyGive(task());
+    return true;
+}
+
+void MqttTask::publishPending()
+{
+    if (_mqttClient && _connectionManager && _connectionManager->isMqttActive())
+    {
+        // window of unconfirmed messages, a backlog is not flushed into the broker at once
+        Outbox::Message msg;
+        while (_outbox.inflight() < literals::outbox_window && _outbox.next(msg))
+        {
+            int msgId = _mqttClient->publish(msg.topic, msg.payload, std::max<int>(msg.qos, 1), msg.retain);
+            if (msgId < 0)
+            {
+                _outbox.rewind();
+                break;
+            }
+            _outbox.sent(msgId);
+
+            // one message at a time is timed, its PUBACK is matched by the id
+            if (_probeAt.load() == 0)
+            {
+                _probeId = msgId;
+                _probeAt = esp_timer_get_time();
+            }
+        }
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now - _lastOutboxLog >= 60 * 1000000LL && !_outbox.empty())
+    {
+        _lastOutboxLog = now;
+        auto st = _outbox.stats();
+        ESP_LOGI(LOG_TAG, "Outbox %lu messages (%lu B in RAM, %lu segments on card), oldest %lu s, sent %lu, dropped %lu",
+                 (unsigned long)st.queued, (unsigned long)st.ringBytes, (unsigned long)st.segments,
+                 (unsigned long)st.ageSec, (unsigned long)st.sent, (unsigned long)st.dropped);
+    }
+}
+
 void MqttTask::initializeMqttClient()
 {
 
-    KeyVal &kv = KeyVal::getInstance();
     // Only create the client if it hasn't been created
     if (!_mqttClient)
     {
         _mqttClient = std::make_unique<Mqtt>();
-        // Set up MQTT callbacks
+        // Set up MQTT callbacks, the task loop is woken up to run the state machine
         _mqttClient->registerConnectedCallback([&]()
                                                {
                                                    ESP_LOGI(LOG_TAG, "Connected to MQTT broker");
                                                    if (_connectionManager)
                                                        _connectionManager->setMqttActive();
+                                                   xTaskNotifyGive(task());
                                                    Application::getInstance()->getDisplayTask()->settingMsg("Connected to MQTT broker"); });
+        // confirmations are matched by id, esp-mqtt also reports its own resends
+        _mqttClient->registerPublishedCallback([this](int msgId)
+                                               {
+                                                   _outbox.ack(msgId);
+                                                   int64_t at = _probeAt.load();
+                                                   if (at && msgId == _probeId.load())
+                                                   {
+                                                       uint32_t ms = static_cast<uint32_t>((esp_timer_get_time() - at) / 1000);
+                                                       _rttSumMs += ms;
+                                                       _rttCount++;
+                                                       uint32_t max = _rttMaxMs.load();
+                                                       while (ms > max && !_rttMaxMs.compare_exchange_weak(max, ms))
+                                                           ;
+                                                       _probeAt = 0;
+                                                   }
+                                                   xTaskNotifyGive(task()); });
         _mqttClient->registerDisconnectedCallback([&]()
                                                   {
             ESP_LOGI(LOG_TAG, "Disconnected from MQTT broker");
              if (_connectionManager) _connectionManager->setMqttDeactive(); 
+             _outbox.rewind();
+             resetProbe();
+             _connectFailed = true;
+             xTaskNotifyGive(task());
              Application::getInstance()->getDisplayTask()->settingMsg("Disconnected from MQTT broker"); });
 
+        const Config cfg = ConfigStore::getInstance().get();
         std::string mqtt;
         mqtt = "mqtt://";
-        mqtt += kv.readString(literals::kv_mqtt);
-        if (!_mqttClient->init(mqtt, kv.readString(literals::kv_user), kv.readString(literals::kv_passwd)))
+        mqtt += cfg.mqtt;
+        if (!_mqttClient->init(mqtt, cfg.user, cfg.passwdbr, PowerProfile::get(cfg.power).mqttKeepaliveSec))
         {
             ESP_LOGE(LOG_TAG, "Failed to initialize MQTT client");
             Application::getInstance()->getDisplayTask()->settingMsg("Failed to initialize MQTT client");
@@ -76,64 +150,238 @@ void MqttTask::doneMqttClient()
     {
         _mqttClient.reset();
     }
+
+    // unconfirmed messages are sent again by the next client
+    _outbox.rewind();
+    resetProbe();
+
+    // destroyed client does not report the disconnection
+    if (_connectionManager)
+        _connectionManager->setMqttDeactive();
+}
+
+void MqttTask::resetProbe()
+{
+    // the timed message is sent again with a new id
+    _probeAt = 0;
+    _probeId = 0;
+}
+
+MqttTask::Latency MqttTask::latency(bool reset)
+{
+    Latency l;
+    l.received = reset ? _received.exchange(0) : _received.load();
+    l.maxGapMs = reset ? _maxGapMs.exchange(0) : _maxGapMs.load();
+    l.acks = reset ? _rttCount.exchange(0) : _rttCount.load();
+    uint32_t sum = reset ? _rttSumMs.exchange(0) : _rttSumMs.load();
+    l.maxMs = reset ? _rttMaxMs.exchange(0) : _rttMaxMs.load();
+    l.avgMs = l.acks ? sum / l.acks : 0;
+    return l;
+}
+
+void MqttTask::subscribeTopics(const std::vector<std::string> &topics)
+{
+    MqttMessageCallback callback = [this](std::string_view topic, std::string_view message)
+    { onMessage(topic, message); };
+
+    for (const auto &topic : topics)
+    {
+        ESP_LOGI(LOG_TAG, "Topic registration [%s]", topic.c_str());
+        _mqttClient->subscribe(topic, callback);
+    }
+}
+
+void MqttTask::onMessage(std::string_view topic, std::string_view message)
+{
+    JsonSerializer::updateParametersFromJson(_solaxData, message);
+    _counter++;
+    _received++;
+
+    int64_t now = esp_timer_get_time();
+    int64_t start = _dataWaitStart.exchange(0);
+    if (start)
+    {
+        ESP_LOGI(LOG_TAG, "Data received %lld ms after %s", (long long)(now - start) / 1000, _dataWaitReason.load());
+    }
+    else if (_lastDataAt)
+    {
+        // modem sleep holds incoming frames in the AP until the next wake, that shows as a gap
+        uint32_t gap = static_cast<uint32_t>((now - _lastDataAt) / 1000);
+        uint32_t max = _maxGapMs.load();
+        while (gap > max && !_maxGapMs.compare_exchange_weak(max, gap))
+            ;
+    }
+    _lastDataAt = now;
+
+    // number of necessary data received for GUI update
+    if (_counter > 20)
+    {
+        _counter = 0;
+        Application::getInstance()->getDisplayTask()->updateUI(_solaxData);
+    }
+}
+
+void MqttTask::waitForData(const char *reason)
+{
+    // the first (older) cause is measured
+    int64_t expected = 0;
+    if (_dataWaitStart.compare_exchange_strong(expected, esp_timer_get_time()))
+        _dataWaitReason = reason;
+}
+
+void MqttTask::setLink(Link link)
+{
+    static constexpr const char *names[] = {"Offline", "Connecting", "Online", "Waiting"};
+    if (_link != link)
+    {
+        ESP_LOGI(LOG_TAG, "Link %s -> %s", names[static_cast<int>(_link)], names[static_cast<int>(link)]);
+        _link = link;
+    }
 }
 
 void MqttTask::loop()
 {
-    KeyVal &kv = KeyVal::getInstance();
-    auto topic = kv.readString(literals::kv_topic, "solax/data");
+    // several sources (inverter, heat pump, sensors) publish the same name/value messages
+    auto topics = ConfigStore::getInstance().get().topics();
+
+    // applied in this loop, the listener only marks what changed
+    ConfigStore::getInstance().subscribe(Config::Wifi | Config::Network | Config::Mqtt | Config::Topic | Config::Power,
+                                         [this](const Config &, uint32_t changed)
+                                         {
+                                             _reconfigure |= changed;
+                                             waitForData("reconfiguration");
+                                             xTaskNotifyGive(task());
+                                         });
+
+    // WiFi edges wake the loop, MQTT edges come from the client callbacks
+    if (_connectionManager)
+        _connectionManager->onChange(ConnectionManager::Wifi, [this](EventBits_t, EventBits_t)
+                                     { xTaskNotifyGive(task()); });
+
     Application::getInstance()->signalTaskStart(Application::TaskBit::Mqtt);
-    bool subscribe = false;
-    uint16_t counter = 0;  
     std::memset(&_solaxData, 0, sizeof(SolaxParameters));
     Application::getInstance()->getDisplayTask()->updateUI(_solaxData);
+
+    int64_t deadline = 0; // end of the connection attempt or of the backoff
     while (true)
     { // Loop forever
 
-        // Check connection status
-        if (_connectionManager && _connectionManager->isConnected())
+        uint32_t changed = _reconfigure.exchange(0);
+        if (changed & (Config::Mqtt | Config::Power))
         {
-            if (!_mqttInitialized)
-            {
-                initializeMqttClient(); // Initialize MQTT only once upon connection
-                _mqttInitialized = true;
-            }
+            // new broker, credentials or keepalive - new client, WiFi stays up
+            ESP_LOGI(LOG_TAG, "Broker or power profile changed, restarting MQTT client");
+            doneMqttClient();
+            _backoff.reset();
+            setLink(Link::Offline);
         }
-        else
+        if (changed & Config::Topic)
         {
-            // Connection lost
-            if (_mqttInitialized)
+            if (_mqttClient)
             {
-                // Clean up the MQTT client if it was previously initialized
-                doneMqttClient();
+                for (const auto &topic : topics)
+                    _mqttClient->unsubscribe(topic);
             }
-            _mqttInitialized = false;
+            topics = ConfigStore::getInstance().get().topics();
+            if (_mqttClient)
+                subscribeTopics(topics);
         }
 
-        if (_connectionManager && _connectionManager->isMqttActive() && !subscribe)
+        const bool wifi = _connectionManager && _connectionManager->isConnected();
+        const bool online = _connectionManager && _connectionManager->isMqttActive();
+        const bool failed = _connectFailed.exchange(false);
+        const int64_t now = esp_timer_get_time();
+
+        if (!wifi && _link != Link::Offline)
         {
-            ESP_LOGI(LOG_TAG, "Topic registration [%s]", topic.c_str());
-            subscribe = true;
-            _mqttClient->subscribe(topic, [this, &counter](std::string_view topic, std::string_view message) { 
-                JsonSerializer::updateParametersFromJson(_solaxData, message);
-                counter++;
-
-                // number of necessary data received for GUI update
-                if (counter > 20) {
-                    counter = 0; 
-                    Application::getInstance()->getDisplayTask()->updateUI(_solaxData);
-                }
-                });
+            // the old TCP session is dead, do not wait for the keepalive to find out
+            if (_mqttClient)
+                _mqttClient->disconnect();
+            waitForData("link loss");
+            setLink(Link::Offline);
         }
 
-        if (_connectionManager && !_connectionManager->isMqttActive() && subscribe)
+        switch (_link)
         {
-            //ESP_LOGI(LOG_TAG, "Topic remove [%s]", topic.c_str());
-            //_mqttClient->unsubscribe(topic);
-            //subscribe = false;
+        case Link::Offline:
+            if (wifi)
+            {
+                // the client is created once and reused, subscriptions are kept in it
+                if (!_mqttClient)
+                {
+                    initializeMqttClient();
+                    subscribeTopics(topics);
+                }
+                else if (!_mqttClient->reconnect())
+                {
+                    // still closing the previous session
+                    deadline = now + _backoff.next() * 1000LL;
+                    setLink(Link::Waiting);
+                    break;
+                }
+                deadline = now + literals::mqtt_connect_timeout_ms * 1000LL;
+                setLink(Link::Connecting);
+            }
+            break;
+
+        case Link::Connecting:
+            if (online)
+            {
+                _backoff.reset();
+                _mqttClient->resubscribe();
+                setLink(Link::Online);
+            }
+            else if (failed || now >= deadline)
+            {
+                uint32_t delay = _backoff.next();
+                ESP_LOGW(LOG_TAG, "Broker not reachable, retry in %lu ms (attempt %lu, %lu in the last hour)",
+                         (unsigned long)delay, (unsigned long)_backoff.step(), (unsigned long)_backoff.attemptsLastHour());
+                deadline = now + delay * 1000LL;
+                setLink(Link::Waiting);
+            }
+            break;
+
+        case Link::Online:
+            if (!online)
+            {
+                waitForData("broker loss");
+                deadline = now + _backoff.next() * 1000LL;
+                setLink(Link::Waiting);
+            }
+            break;
+
+        case Link::Waiting:
+            if (online)
+            {
+                // CONNECTED of an attempt that already timed out
+                _backoff.reset();
+                _mqttClient->resubscribe();
+                setLink(Link::Online);
+            }
+            else if (now >= deadline)
+            {
+                if (_mqttClient->reconnect())
+                {
+                    deadline = now + literals::mqtt_connect_timeout_ms * 1000LL;
+                    setLink(Link::Connecting);
+                }
+                else
+                    deadline = now + _backoff.next() * 1000LL;
+            }
+            break;
         }
 
+        publishPending();
 
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        // sleep until an event (WiFi, client, publish, settings) or the deadline
+        TickType_t wait = portMAX_DELAY;
+        if (_link == Link::Waiting || _link == Link::Connecting)
+        {
+            int64_t left = deadline - esp_timer_get_time();
+            wait = left > 0 ? pdMS_TO_TICKS(left / 1000 + 1) : 0;
+        }
+        if (!_outbox.empty())
+            wait = std::min<TickType_t>(wait, pdMS_TO_TICKS(60 * 1000)); // backlog report
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
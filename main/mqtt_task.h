@@ -8,13 +8,18 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "hardware.h"
 #include "rptask.h"
 #include "mqtt.h"
 #include "literals.h"
 #include "connection_manager.h"
-#include  "mqtt_queue_data.h"
+#include "outbox.h"
+#include "backoff.h"
 #include "mqtt_queue_data.h"
 
 class MqttTask : public RPTask
@@ -24,18 +29,68 @@ public:
 	virtual ~MqttTask();
 	bool init(std::shared_ptr<ConnectionManager> connMgr, const char * name, UBaseType_t priority = tskIDLE_PRIORITY, const configSTACK_DEPTH_TYPE stackDepth = configMINIMAL_STACK_SIZE);
 
+	/// @brief Queue outbound message (any task). Kept in the outbox while offline and
+	/// delivered with QoS 1 at least, in the order of publishing.
+	/// @return false - message dropped
+	bool publish(std::string_view topic, std::string payload, int qos = 0, bool retain = false);
+
+	/// @brief Backlog of the outbound messages
+	Outbox::Stats outboxStats() const { return _outbox.stats(); }
+
+	/// @brief Incoming data and broker round trip since the last reset
+	struct Latency {
+		uint32_t received{0};	///< incoming messages
+		uint32_t maxGapMs{0};	///< longest time without incoming data (delivery held by modem sleep)
+		uint32_t acks{0};		///< timed PUBACKs
+		uint32_t avgMs{0};		///< round trip publish -> PUBACK
+		uint32_t maxMs{0};
+	};
+	Latency latency(bool reset = false);
+
 protected:
+	/// @brief Broker link state, driven by the task loop
+	enum class Link {
+		Offline,		// no WiFi, client idle
+		Connecting,		// connection attempt in progress
+		Online,			// connected and subscribed
+		Waiting			// backoff before the next attempt
+	};
+
 	void loop() override;
 	void initializeMqttClient();
 	void doneMqttClient();
+	void publishPending();
+	void subscribeTopics(const std::vector<std::string> &topics);
+	void onMessage(std::string_view topic, std::string_view message);
+	void waitForData(const char *reason);
+	void setLink(Link link);
+	void resetProbe();
 
 private:
 	static constexpr const char *LOG_TAG = "MqttTask";
 	std::shared_ptr<ConnectionManager> _connectionManager;
 	// Unique pointer to the MQTT client object
     std::unique_ptr<Mqtt> _mqttClient {};
-    // Boolean flag to track if the client is connected
-	 bool _mqttInitialized{false};
 	 SolaxParameters _solaxData;
+	 std::atomic<uint32_t> _reconfigure{0};		///< Config::Group mask waiting to be applied
+	 std::atomic<int64_t> _dataWaitStart{0};	///< reconfiguration or link loss, for time-to-data
+	 std::atomic<const char *> _dataWaitReason{""};
+	 std::atomic<bool> _connectFailed{false};	///< disconnected event, set by the esp-mqtt task
+	 Link _link{Link::Offline};
+	 Backoff _backoff{literals::mqtt_backoff_base_ms, literals::mqtt_backoff_cap_ms};
+	 uint16_t _counter{0};
+	 Outbox _outbox;
+	 int64_t _lastOutboxLog{0};
+
+	 // round trip probe, the published callback runs in the esp-mqtt task
+	 std::atomic<int> _probeId{0};			///< msg_id of the timed message
+	 std::atomic<int64_t> _probeAt{0};		///< send time of the timed message, 0 - none
+	 std::atomic<uint32_t> _rttSumMs{0};
+	 std::atomic<uint32_t> _rttCount{0};
+	 std::atomic<uint32_t> _rttMaxMs{0};
+	 // incoming data, onMessage runs in the esp-mqtt task
+	 std::atomic<uint32_t> _received{0};
+	 std::atomic<uint32_t> _maxGapMs{0};
+	 int64_t _lastDataAt{0};
 
 };
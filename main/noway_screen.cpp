@@ -44,6 +44,12 @@ bool NoWayScreen::init()
 
         _buttonFields = std::make_shared<std::vector<ButtonField>>(
             std::initializer_list<ButtonField>{
+                {"Close setup", lv_color_hex(0x000000), lv_color_hex(UIStyle::Green), [this]()
+                 {
+                     // AP down, STA kept or started again
+                     Application::getInstance()->getWifiTask()->switchMode(WifiTask::Mode::Client);
+                     ScreenManager::getInstance()->showScreenByType(ScreenType::Main);
+                 }},
                 {"Restart", lv_color_hex(0xFFFFFF), lv_color_hex(UIStyle::Red), [this]()
                  {
                      Application::getInstance()->getResetTask()->reset();
@@ -0,0 +1,496 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   outbox.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <time.h>
+#include <stdio.h>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "key_val.h"
+#include "literals.h"
+#include "storage_task.h"
+
+/// @brief Store-and-forward queue of outbound MQTT messages.
+///
+/// Messages are kept in a byte ring in PSRAM. When the ring is full, new messages
+/// are appended to SD card segments (/obx<n>.q) through the storage task; once a
+/// message went to the card, all newer ones follow it, so the order is preserved.
+/// The sender takes messages with next(), binds the client message id with sent()
+/// and removes them with ack(id) when the broker confirmed them, so a connection lost
+/// in the middle resends from the oldest unconfirmed one (at least once). Ids of no
+/// message in flight (esp-mqtt resends its own copies after a reconnect) are ignored.
+/// An empty ring reloads the oldest segment, a segment never holds more than fits
+/// into the empty ring. Segment numbers are kept in NVS, a backlog on the card
+/// survives a reboot.
+/// push() is called by the producers, next()/sent()/ack() by the MQTT client and the reload
+/// by the storage task, everything is serialized by one mutex.
+class Outbox
+{
+public:
+    /// @brief One stored message
+    struct Message
+    {
+        uint32_t time{0}; ///< when it was queued
+        uint8_t qos{0};
+        bool retain{false};
+        std::string topic;
+        std::string payload;
+    };
+
+    /// @brief Backlog statistics
+    struct Stats
+    {
+        uint32_t queued;   ///< messages waiting (ring + card)
+        uint32_t ringBytes; ///< bytes used in the ring
+        uint32_t segments; ///< segments on the card
+        uint32_t ageSec;   ///< age of the oldest message
+        uint32_t sent;     ///< messages handed to the client
+        uint32_t dropped;  ///< messages lost - card full, missing or write failed
+    };
+
+    Outbox() = default;
+
+    ~Outbox()
+    {
+        if (_ring)
+            heap_caps_free(_ring);
+    }
+
+    Outbox(Outbox const &) = delete;
+    void operator=(Outbox const &) = delete;
+
+    /// @brief Allocates the ring, restores the segments left on the card
+    /// @param storage SD card owner, nullptr - ring only
+    bool init(StorageTask *storage)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _storage = storage;
+        if (!_ring)
+        {
+            _ring = static_cast<uint8_t *>(heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM));
+            if (!_ring)
+            {
+                ESP_LOGE(TAG, "No memory for %u B ring", (unsigned)capacity);
+                return false;
+            }
+        }
+
+        KeyVal &kv = KeyVal::getInstance();
+        uint32_t first = kv.readUint32(literals::kv_obx_first, 0);
+        uint32_t next = kv.readUint32(literals::kv_obx_next, 0);
+        if (next - first > literals::outbox_max_segments)
+            first = next; // corrupted, start over
+        _nextSeq = next;
+        for (uint32_t seq = first; seq != next; seq++)
+        {
+            // content is unknown until reloaded, the segment is never appended again
+            _segments.push_back(Segment{seq, 0, 0, 0, true});
+        }
+
+        if (!_segments.empty())
+            ESP_LOGI(TAG, "%u segments restored from the card", (unsigned)_segments.size());
+        return true;
+    }
+
+    /// @brief Queue message, timestamped now
+    /// @return false - dropped
+    bool push(std::string_view topic, std::string_view payload, int qos, bool retain)
+    {
+        if (topic.empty() || topic.size() > 0xFFFF || payload.size() > capacity / 2)
+        {
+            ESP_LOGW(TAG, "Message for [%.*s] rejected", (int)topic.size(), topic.data());
+            return false;
+        }
+
+        Header hdr{static_cast<uint32_t>(time(nullptr)), static_cast<uint32_t>(payload.size()),
+                   static_cast<uint16_t>(topic.size()), static_cast<uint8_t>(qos), retain};
+        const size_t size = sizeof(Header) + topic.size() + payload.size();
+
+        uint32_t persistNext = 0;
+        bool ok = true;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_ring)
+            {
+                _dropped++;
+                return false;
+            }
+
+            // nothing on the card and room in the ring - the fast path
+            if (_segments.empty() && _used + size <= capacity)
+            {
+                write(hdr, topic, payload);
+                return true;
+            }
+
+            ok = spill(hdr, topic, payload, size, persistNext);
+        }
+
+        if (persistNext)
+            KeyVal::getInstance().writeUint32(literals::kv_obx_next, persistNext);
+        return ok;
+    }
+
+    /// @brief Next message to send, it stays queued until ack() of its id
+    /// @return false - nothing more to send (a segment may be loading)
+    bool next(Message &msg)
+    {
+        bool reload = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_inflight.size() < _count)
+            {
+                Header hdr;
+                size_t pos = read(_cursor, &hdr, sizeof(hdr));
+                msg.time = hdr.time;
+                msg.qos = hdr.qos;
+                msg.retain = hdr.retain;
+                msg.topic.resize(hdr.topicLen);
+                pos = read(pos, msg.topic.data(), hdr.topicLen);
+                msg.payload.resize(hdr.payloadLen);
+                _cursor = read(pos, msg.payload.data(), hdr.payloadLen);
+                _inflight.push_back(Inflight{0, false});
+                return true;
+            }
+
+            reload = _count == 0 && !_segments.empty() && !_reloading;
+            if (reload)
+            {
+                _reloading = true;
+                _segments.front().sealed = true; // new messages go to the next segment
+            }
+        }
+
+        if (reload)
+            reloadFront();
+        return false;
+    }
+
+    /// @brief Binds the client message id to the message of the last next()
+    void sent(int msgId)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_inflight.empty() || _inflight.back().msgId != 0 || msgId <= 0)
+            return;
+
+        _inflight.back().msgId = msgId;
+
+        // the confirmation came before the id was bound
+        auto early = std::find(_early.begin(), _early.end(), msgId);
+        if (early != _early.end())
+        {
+            *early = 0;
+            _inflight.back().acked = true;
+            removeConfirmed();
+        }
+    }
+
+    /// @brief Broker confirmed the message msgId. Records leave the ring in order, a message
+    /// confirmed before an older one waits for it.
+    /// @return false - no message in flight with this id
+    bool ack(int msgId)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (msgId <= 0)
+            return false;
+
+        auto it = std::find_if(_inflight.begin(), _inflight.end(), [msgId](const Inflight &f)
+                               { return f.msgId == msgId && !f.acked; });
+        if (it == _inflight.end())
+        {
+            // publish() returned, sent() did not run yet - keep the id for it
+            if (std::any_of(_inflight.begin(), _inflight.end(), [](const Inflight &f)
+                            { return f.msgId == 0; }))
+            {
+                _early[_earlyPos++ % _early.size()] = msgId;
+            }
+            return false;
+        }
+
+        it->acked = true;
+        removeConfirmed();
+        return true;
+    }
+
+    /// @brief Unconfirmed messages are sent again (connection lost or publish failed)
+    void rewind()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cursor = _head;
+        _inflight.clear();
+        _early.fill(0);
+    }
+
+    /// @brief Number of sent and not yet confirmed messages
+    uint32_t inflight() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _inflight.size();
+    }
+
+    bool empty() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _count == 0 && _segments.empty();
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Stats st{};
+        st.queued = _count;
+        st.ringBytes = _used;
+        st.segments = _segments.size();
+        st.sent = _sent;
+        st.dropped = _dropped;
+
+        uint32_t oldest = 0;
+        if (_count > 0)
+        {
+            Header hdr;
+            read(_head, &hdr, sizeof(hdr));
+            oldest = hdr.time;
+        }
+        for (const auto &seg : _segments)
+        {
+            st.queued += seg.count;
+            if (!oldest)
+                oldest = seg.oldest;
+        }
+
+        uint32_t now = static_cast<uint32_t>(time(nullptr));
+        st.ageSec = (oldest && now > oldest) ? now - oldest : 0;
+        return st;
+    }
+
+private:
+    static constexpr const char *TAG = "Outbox";
+    static constexpr size_t capacity = literals::outbox_ring_size;
+
+    struct Header
+    {
+        uint32_t time;
+        uint32_t payloadLen;
+        uint16_t topicLen;
+        uint8_t qos;
+        bool retain;
+    };
+
+    /// @brief Sent record, in the order of the ring from _head
+    struct Inflight
+    {
+        int msgId; ///< 0 - not bound yet
+        bool acked;
+    };
+
+    struct Segment
+    {
+        uint32_t seq;
+        uint32_t count;  ///< records appended in this run
+        uint32_t bytes;  ///< ring bytes needed by the records
+        uint32_t oldest; ///< time of the first record, 0 - unknown
+        bool sealed;     ///< no more appends
+    };
+
+    static std::string segmentPath(uint32_t seq)
+    {
+        char path[24];
+        snprintf(path, sizeof(path), "/obx%lu.q", static_cast<unsigned long>(seq));
+        return path;
+    }
+
+    /// @brief Appends the message to the newest segment (caller holds _mutex)
+    /// @param persistNext set to the new segment counter to be stored in NVS
+    bool spill(const Header &hdr, std::string_view topic, std::string_view payload, size_t size, uint32_t &persistNext)
+    {
+        if (!_storage || !_storage->isMounted())
+        {
+            _dropped++;
+            ESP_LOGW(TAG, "Ring full, no card, message dropped");
+            return false;
+        }
+
+        if (_segments.empty() || _segments.back().sealed || _segments.back().bytes + size > capacity)
+        {
+            if (_segments.size() >= literals::outbox_max_segments)
+            {
+                _dropped++;
+                ESP_LOGW(TAG, "Card backlog full, message dropped");
+                return false;
+            }
+            if (!_segments.empty())
+                _segments.back().sealed = true;
+            _segments.push_back(Segment{_nextSeq++, 0, 0, hdr.time, false});
+            persistNext = _nextSeq;
+        }
+
+        // text record: header fields, then topic and payload of the given lengths
+        std::string rec;
+        rec.reserve(32 + topic.size() + payload.size());
+        char head[48];
+        snprintf(head, sizeof(head), "%lu %u %u %u %lu ", static_cast<unsigned long>(hdr.time), hdr.qos, hdr.retain ? 1u : 0u,
+                 hdr.topicLen, static_cast<unsigned long>(hdr.payloadLen));
+        rec += head;
+        rec.append(topic);
+        rec.append(payload);
+        rec += '\n';
+
+        Segment &seg = _segments.back();
+        if (!_storage->append(segmentPath(seg.seq), std::move(rec)))
+        {
+            _dropped++;
+            return false;
+        }
+        seg.count++;
+        seg.bytes += size;
+        return true;
+    }
+
+    /// @brief Reads the oldest segment into the empty ring (storage task callback)
+    void reloadFront()
+    {
+        uint32_t seq;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            seq = _segments.front().seq;
+        }
+
+        bool queued = _storage && _storage->read(segmentPath(seq), [this, seq](bool ok, std::string &&content)
+                                                 { restore(seq, ok, content); });
+        if (!queued)
+        {
+            // storage busy, retried by the next next()
+            std::lock_guard<std::mutex> lock(_mutex);
+            _reloading = false;
+        }
+    }
+
+    void restore(uint32_t seq, bool ok, const std::string &content)
+    {
+        uint32_t loaded = 0;
+        uint32_t lost = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            size_t pos = 0;
+            while (ok && pos < content.size())
+            {
+                unsigned long t = 0, plen = 0;
+                unsigned qos = 0, retain = 0, tlen = 0;
+                int consumed = 0;
+                if (sscanf(content.c_str() + pos, "%lu %u %u %u %lu %n", &t, &qos, &retain, &tlen, &plen, &consumed) != 5 ||
+                    consumed == 0 || pos + consumed + tlen + plen + 1 > content.size())
+                {
+                    lost++; // torn tail after a power loss
+                    break;
+                }
+                pos += consumed;
+
+                Header hdr{static_cast<uint32_t>(t), static_cast<uint32_t>(plen), static_cast<uint16_t>(tlen),
+                           static_cast<uint8_t>(qos), retain != 0};
+                std::string_view topic(content.data() + pos, tlen);
+                std::string_view payload(content.data() + pos + tlen, plen);
+                pos += tlen + plen + 1;
+
+                if (_used + sizeof(Header) + tlen + plen > capacity)
+                {
+                    lost++;
+                    continue;
+                }
+                write(hdr, topic, payload);
+                loaded++;
+            }
+            if (_count == loaded)
+            {
+                _cursor = _head;
+                _inflight.clear();
+            }
+
+            if (!_segments.empty() && _segments.front().seq == seq)
+            {
+                if (_segments.front().count > loaded)
+                    lost = std::max(lost, _segments.front().count - loaded);
+                _segments.pop_front();
+            }
+            _dropped += lost;
+            _reloading = false;
+        }
+
+        ESP_LOGI(TAG, "Segment %lu reloaded, %lu messages, %lu lost", static_cast<unsigned long>(seq),
+                 static_cast<unsigned long>(loaded), static_cast<unsigned long>(lost));
+        _storage->remove(segmentPath(seq));
+        KeyVal::getInstance().writeUint32(literals::kv_obx_first, seq + 1);
+    }
+
+    /// @brief Removes the confirmed records at the head (caller holds _mutex)
+    void removeConfirmed()
+    {
+        while (!_inflight.empty() && _inflight.front().acked && _count > 0)
+        {
+            Header hdr;
+            read(_head, &hdr, sizeof(hdr));
+            size_t size = sizeof(Header) + hdr.topicLen + hdr.payloadLen;
+            _head = (_head + size) % capacity;
+            _used -= size;
+            _count--;
+            _sent++;
+            _inflight.pop_front();
+        }
+    }
+
+    /// @brief Stores the record at the tail (caller holds _mutex and checked the space)
+    void write(const Header &hdr, std::string_view topic, std::string_view payload)
+    {
+        size_t pos = (_head + _used) % capacity;
+        pos = copyIn(pos, &hdr, sizeof(hdr));
+        pos = copyIn(pos, topic.data(), topic.size());
+        copyIn(pos, payload.data(), payload.size());
+        _used += sizeof(hdr) + topic.size() + payload.size();
+        _count++;
+    }
+
+    size_t copyIn(size_t pos, const void *src, size_t len)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(src);
+        size_t first = std::min(len, capacity - pos);
+        memcpy(_ring + pos, p, first);
+        memcpy(_ring, p + first, len - first);
+        return (pos + len) % capacity;
+    }
+
+    size_t read(size_t pos, void *dst, size_t len) const
+    {
+        uint8_t *p = static_cast<uint8_t *>(dst);
+        size_t first = std::min(len, capacity - pos);
+        memcpy(p, _ring + pos, first);
+        memcpy(p + first, _ring, len - first);
+        return (pos + len) % capacity;
+    }
+
+    mutable std::mutex _mutex;
+    StorageTask *_storage{nullptr};
+    uint8_t *_ring{nullptr};
+    size_t _head{0};  ///< offset of the oldest record
+    size_t _cursor{0}; ///< offset of the next record to send
+    std::deque<Inflight> _inflight; ///< sent, not removed yet
+    std::array<int, literals::outbox_window> _early{}; ///< confirmations of not yet bound ids
+    uint32_t _earlyPos{0};
+    size_t _used{0};  ///< bytes in the ring
+    uint32_t _count{0};
+    std::deque<Segment> _segments;
+    uint32_t _nextSeq{0};
+    bool _reloading{false};
+    uint32_t _sent{0};
+    uint32_t _dropped{0};
+};
@@ -0,0 +1,158 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   power_monitor.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "esp_log.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "hardware.h"
+
+/*
+
+    PowerMonitor pm;
+    pm.init();                  // false - no shunt fitted, only the backlight share is counted
+    pm.sample(backlightOn);     // periodically
+    auto st = pm.take();        // statistics since the last take()
+
+*/
+
+/// @brief Supply current from the shunt amplifier on HW_SHUNT_ADC_CHANNEL
+/// and the share of time with the backlight on
+class PowerMonitor
+{
+public:
+    struct Stats
+    {
+        uint32_t samples{0};
+        bool measured{false};     ///< current values are valid
+        uint32_t minMa{0};
+        uint32_t avgMa{0};
+        uint32_t maxMa{0};
+        uint32_t backlightPct{0}; ///< samples with the backlight on
+    };
+
+    PowerMonitor() = default;
+
+    ~PowerMonitor()
+    {
+        if (_cali)
+            adc_cali_delete_scheme_curve_fitting(_cali);
+        if (_adc)
+            adc_oneshot_del_unit(_adc);
+    }
+
+    PowerMonitor(const PowerMonitor &) = delete;
+    PowerMonitor &operator=(const PowerMonitor &) = delete;
+
+    /// @return false - no shunt configured or the ADC is not available
+    bool init()
+    {
+        if constexpr (HW_SHUNT_MV_PER_A <= 0)
+        {
+            ESP_LOGI(TAG, "No shunt fitted, current is not measured");
+            return false;
+        }
+
+        adc_oneshot_unit_init_cfg_t unitCfg = {};
+        unitCfg.unit_id = HW_SHUNT_ADC_UNIT;
+        if (adc_oneshot_new_unit(&unitCfg, &_adc) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "ADC unit init failed");
+            _adc = nullptr;
+            return false;
+        }
+
+        // 12 dB - up to ~3.1 V on the pin
+        adc_oneshot_chan_cfg_t chanCfg = {};
+        chanCfg.atten = ADC_ATTEN_DB_12;
+        chanCfg.bitwidth = ADC_BITWIDTH_DEFAULT;
+        adc_oneshot_config_channel(_adc, HW_SHUNT_ADC_CHANNEL, &chanCfg);
+
+        adc_cali_curve_fitting_config_t caliCfg = {};
+        caliCfg.unit_id = HW_SHUNT_ADC_UNIT;
+        caliCfg.chan = HW_SHUNT_ADC_CHANNEL;
+        caliCfg.atten = ADC_ATTEN_DB_12;
+        caliCfg.bitwidth = ADC_BITWIDTH_DEFAULT;
+        if (adc_cali_create_scheme_curve_fitting(&caliCfg, &_cali) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "ADC calibration not available");
+            _cali = nullptr;
+        }
+
+        ESP_LOGI(TAG, "Shunt on ADC%d channel %d, %d mV/A", HW_SHUNT_ADC_UNIT + 1, HW_SHUNT_ADC_CHANNEL, HW_SHUNT_MV_PER_A);
+        return true;
+    }
+
+    /// @brief One reading, averaged over a few conversions
+    void sample(bool backlightOn)
+    {
+        _samples++;
+        if (backlightOn)
+            _backlightOn++;
+
+        if (!_adc)
+            return;
+
+        int sum = 0;
+        for (int i = 0; i < oversample; i++)
+        {
+            int raw = 0;
+            if (adc_oneshot_read(_adc, HW_SHUNT_ADC_CHANNEL, &raw) != ESP_OK)
+                return;
+            sum += raw;
+        }
+
+        int raw = sum / oversample;
+        int mv = 0;
+        if (!_cali || adc_cali_raw_to_voltage(_cali, raw, &mv) != ESP_OK)
+            mv = raw * 3100 / 4095; // uncalibrated estimate
+
+        uint32_t ma = static_cast<uint32_t>(mv) * 1000 / std::max(HW_SHUNT_MV_PER_A, 1);
+        if (_measured == 0)
+            _minMa = _maxMa = ma;
+        _minMa = std::min(_minMa, ma);
+        _maxMa = std::max(_maxMa, ma);
+        _sumMa += ma;
+        _measured++;
+    }
+
+    /// @brief Statistics since the last call, counters start again
+    Stats take()
+    {
+        Stats st;
+        st.samples = _samples;
+        st.measured = _measured > 0;
+        if (st.measured)
+        {
+            st.minMa = _minMa;
+            st.maxMa = _maxMa;
+            st.avgMa = static_cast<uint32_t>(_sumMa / _measured);
+        }
+        st.backlightPct = _samples ? _backlightOn * 100 / _samples : 0;
+
+        _samples = _backlightOn = _measured = 0;
+        _sumMa = 0;
+        return st;
+    }
+
+private:
+    static constexpr const char *TAG = "PowerMonitor";
+    static constexpr int oversample = 8;
+
+    adc_oneshot_unit_handle_t _adc{nullptr};
+    adc_cali_handle_t _cali{nullptr};
+    uint32_t _samples{0};
+    uint32_t _backlightOn{0};
+    uint32_t _measured{0};
+    uint64_t _sumMa{0};
+    uint32_t _minMa{0};
+    uint32_t _maxMa{0};
+};
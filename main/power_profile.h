@@ -0,0 +1,57 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   power_profile.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include "esp_wifi.h"
+
+/// @brief Power profile selected in the settings (pwrprof).
+/// The inverter publishes every few seconds, modem sleep delays the incoming data
+/// by the listen interval at most (n x 102.4 ms beacons), which is below the cadence.
+/// The keepalive is only the idle check, data flow keeps the session alive.
+struct PowerProfile
+{
+    const char *name;
+    wifi_ps_type_t wifiPs;    ///< modem sleep
+    uint16_t listenInterval;  ///< beacons between wake-ups with WIFI_PS_MAX_MODEM, 0 - default (3)
+    int mqttKeepaliveSec;     ///< MQTT keepalive
+    bool nightBacklightOff;   ///< backlight off at night (local time)
+    bool hdoBacklightOff;     ///< backlight off while HDO (low tariff) is active
+
+    static constexpr const char *performance = "performance";
+    static constexpr const char *balanced = "balanced";
+    static constexpr const char *saver = "saver";
+
+    /// @brief Profile by name
+    /// @return nullptr - unknown name
+    static const PowerProfile *find(std::string_view name)
+    {
+        for (const auto &p : profiles)
+        {
+            if (name == p.name)
+                return &p;
+        }
+        return nullptr;
+    }
+
+    /// @brief Profile by name, the balanced one for an unknown name
+    static const PowerProfile &get(std::string_view name)
+    {
+        const PowerProfile *p = find(name);
+        return p ? *p : profiles[1];
+    }
+
+    static const PowerProfile profiles[3];
+};
+
+inline const PowerProfile PowerProfile::profiles[3] = {
+    {PowerProfile::performance, WIFI_PS_NONE, 0, 30, false, false},
+    {PowerProfile::balanced, WIFI_PS_MIN_MODEM, 0, 60, true, false},
+    {PowerProfile::saver, WIFI_PS_MAX_MODEM, 10, 120, true, true},
+};
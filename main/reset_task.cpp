@@ -38,6 +38,10 @@ void ResetTask::loop() {
                 ESP_LOGI(LOG_TAG, "Free stack before restart: %d", uxTaskGetStackHighWaterMark(NULL));
                 ESP_LOGI(LOG_TAG,"RESET !!");
                 Application::getInstance()->getDisplayTask()->settingMsg("Reset!");
+                if (!Application::getInstance()->getDisplayTask()->checkpointNow())
+                    ESP_LOGW(LOG_TAG, "Checkpoint before restart failed");
+                // write-behind buffers of the storage task
+                Application::getInstance()->getStorageTask()->flush();
                 vTaskDelay(pdMS_TO_TICKS(2000));  
                 Application::getInstance()->getWifiTask()->switchMode(WifiTask::Mode::Stop);
                  vTaskDelay(pdMS_TO_TICKS(10));
@@ -12,6 +12,11 @@
 #include <cstdio>
 #include <cstring>
 #include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <esp_timer.h>
 #include "hardware.h"
 #include <esp_vfs_fat.h>
 #include <sdmmc_cmd.h>
@@ -26,11 +31,25 @@ private:
     std::string _mountPoint;
     sdmmc_card_t *_sdCard;
     int _mosi, _miso, _clk, _cs;
+    int _freqKhz;
     SemaphoreHandle_t _mutex;
 
+    static constexpr size_t _allocationUnit = 16 * 1024;  ///< FAT cluster, also the largest DMA transfer
+    static constexpr size_t _ioBufferSize = 4 * 1024;     ///< stdio buffer of opened files
+
 public:
-    SdCard(const std::string &mountPoint, int mosi, int miso, int clk, int cs)
-        : _mountPoint(mountPoint), _sdCard(nullptr), _mosi(mosi), _miso(miso), _clk(clk), _cs(cs)
+    /// @brief Result of benchmark()
+    struct Benchmark
+    {
+        float writeMBs{0};          ///< sequential write incl. fsync
+        float readMBs{0};           ///< sequential read
+        uint32_t appendAvgUs{0};    ///< small record append + fsync, 0 - none completed
+        uint32_t appendMaxUs{0};
+        uint32_t appends{0};        ///< completed appends
+    };
+
+    SdCard(const std::string &mountPoint, int mosi, int miso, int clk, int cs, int freqKhz = SDMMC_FREQ_DEFAULT)
+        : _mountPoint(mountPoint), _sdCard(nullptr), _mosi(mosi), _miso(miso), _clk(clk), _cs(cs), _freqKhz(freqKhz)
     {
         _mutex = xSemaphoreCreateMutex();
     }
@@ -61,7 +80,7 @@ public:
             .sclk_io_num = _clk,
             .quadwp_io_num = -1,
             .quadhd_io_num = -1,
-            .max_transfer_sz = 4000};
+            .max_transfer_sz = _allocationUnit};
 
         if (spi_bus_free(SPI2_HOST) == ESP_OK)
         {
@@ -83,8 +102,17 @@ public:
         slotConfig.host_id = SPI2_HOST;
 
         sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+        host.max_freq_khz = _freqKhz;
 
         ret = esp_vfs_fat_sdspi_mount(_mountPoint.c_str(), &host, &slotConfig, &mountConfig, &_sdCard);
+        // older cards and long wiring do not run SPI at the high speed clock
+        if (ret != ESP_OK && _freqKhz > SDMMC_FREQ_DEFAULT)
+        {
+            ESP_LOGW(TAG, "Mount at %d kHz failed, retry at %d kHz", _freqKhz, SDMMC_FREQ_DEFAULT);
+            host.max_freq_khz = SDMMC_FREQ_DEFAULT;
+            ret = esp_vfs_fat_sdspi_mount(_mountPoint.c_str(), &host, &slotConfig, &mountConfig, &_sdCard);
+        }
+
         if (ret != ESP_OK)
         {
             ESP_LOGE(TAG, "Failed to mount filesystem: %s", esp_err_to_name(ret));
@@ -92,7 +120,7 @@ public:
             return ret;
         }
 
-        ESP_LOGI(TAG, "SD card mounted successfully at %s", _mountPoint.c_str());
+        ESP_LOGI(TAG, "SD card mounted successfully at %s, clock %d kHz", _mountPoint.c_str(), _sdCard->real_freq_khz);
         return ESP_OK;
     }
 
@@ -147,13 +175,15 @@ public:
     std::string readFile(const std::string &path) const
     {
         std::string content;
-        FILE *file = fopen((_mountPoint + path).c_str(), "r");
+        FILE *file = fopen((_mountPoint + path).c_str(), "rb");
         if (file)
         {
-            char buffer[1024];
-            while (fgets(buffer, sizeof(buffer), file))
+            // single allocation and a single fread, the FAT driver reads whole clusters
+            struct stat st;
+            if (fstat(fileno(file), &st) == 0 && st.st_size > 0)
             {
-                content += buffer;
+                content.resize(st.st_size);
+                content.resize(fread(content.data(), 1, content.size(), file));
             }
             fclose(file);
         }
@@ -164,20 +194,75 @@ public:
         return content;
     }
 
-    bool writeFile(const std::string &path, const std::string &data) const
+    bool writeFile(const std::string &path, const std::string &data, bool sync = false) const
     {
-        FILE *file = fopen((_mountPoint + path).c_str(), "w");
-        if (file)
+        return store(path, data, "w", sync);
+    }
+
+    bool appendFile(const std::string &path, const std::string &data, bool sync = false) const
+    {
+        return store(path, data, "a", sync);
+    }
+
+    /// @brief Throughput test on the mounted card. Writes, reads and removes a scratch file.
+    /// @param totalBytes size of the sequential test
+    /// @param appends number of small appends
+    Benchmark benchmark(size_t totalBytes = 256 * 1024, int appends = 50) const
+    {
+        Benchmark res;
+        const std::string path = "/bench.tmp";
+        const std::string full = _mountPoint + path;
+
+        std::vector<char> block(_allocationUnit, 0x5a);
+        totalBytes -= totalBytes % block.size();
+
+        do
         {
-            fwrite(data.c_str(), 1, data.size(), file);
+            FILE *file = fopen(full.c_str(), "wb");
+            if (!file)
+                break;
+
+            int64_t start = esp_timer_get_time();
+            size_t written = 0;
+            while (written < totalBytes && fwrite(block.data(), 1, block.size(), file) == block.size())
+                written += block.size();
+            fflush(file);
+            fsync(fileno(file));
             fclose(file);
-            return true;
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Failed to open file for writing: %s", path.c_str());
-            return false;
-        }
+            res.writeMBs = mbs(written, esp_timer_get_time() - start);
+
+            file = fopen(full.c_str(), "rb");
+            if (!file)
+                break;
+
+            start = esp_timer_get_time();
+            size_t read = 0, n;
+            while ((n = fread(block.data(), 1, block.size(), file)) > 0)
+                read += n;
+            fclose(file);
+            res.readMBs = mbs(read, esp_timer_get_time() - start);
+
+            // record of a typical log size
+            const std::string record(64, 'r');
+            uint64_t sum = 0;
+            for (int i = 0; i < appends; i++)
+            {
+                start = esp_timer_get_time();
+                if (!store(path, record, "a", true))
+                    break;
+                uint32_t us = static_cast<uint32_t>(esp_timer_get_time() - start);
+                sum += us;
+                res.appendMaxUs = std::max(res.appendMaxUs, us);
+                res.appends++;
+            }
+            res.appendAvgUs = res.appends > 0 ? static_cast<uint32_t>(sum / res.appends) : 0;
+        } while (false);
+
+        remove(full.c_str());
+
+        ESP_LOGI(TAG, "Benchmark: write %.2f MB/s read %.2f MB/s append avg %" PRIu32 " us max %" PRIu32 " us (%" PRIu32 "/%d)",
+                 res.writeMBs, res.readMBs, res.appendAvgUs, res.appendMaxUs, res.appends, appends);
+        return res;
     }
 
     bool deleteFile(const std::string &path) const
@@ -194,4 +279,37 @@ public:
             return false;
         }
     }
+
+private:
+    static float mbs(size_t bytes, int64_t us)
+    {
+        return us > 0 ? static_cast<float>(bytes) / us : 0; // B/us == MB/s
+    }
+
+    bool store(const std::string &path, const std::string &data, const char *mode, bool sync) const
+    {
+        FILE *file = fopen((_mountPoint + path).c_str(), mode);
+        if (!file)
+        {
+            ESP_LOGE(TAG, "Failed to open file for writing: %s", path.c_str());
+            return false;
+        }
+
+        // default newlib buffer is 128 B, small records would hit the card one by one
+        setvbuf(file, nullptr, _IOFBF, _ioBufferSize);
+
+        bool rc = fwrite(data.c_str(), 1, data.size(), file) == data.size();
+        if (sync)
+        {
+            rc = (fflush(file) == 0) && rc;
+            rc = (fsync(fileno(file)) == 0) && rc;
+        }
+
+        rc = (fclose(file) == 0) && rc;
+        if (!rc)
+        {
+            ESP_LOGE(TAG, "Failed to write file: %s", path.c_str());
+        }
+        return rc;
+    }
 };
@@ -10,7 +10,7 @@
 #include "ui/screen_manager.h"
 #include "ui/ui_style.h"
 #include "literals.h"
-#include "key_val.h"
+#include "config.h"
 #include "noway_screen.h"
 #include "application.h"
 
@@ -51,13 +51,18 @@ bool SettingScreen::init()
 
         _buttonFields = std::make_shared<std::vector<ButtonField>>(
             std::initializer_list<ButtonField>{
-                {"Apply changes & Restart", lv_color_hex(0xFFFFFF), lv_color_hex(UIStyle::Blue), [this]()
+                {"Apply changes", lv_color_hex(0xFFFFFF), lv_color_hex(UIStyle::Blue), [this]()
                  {
-                    saveSetting();
-                    Application::getInstance()->getResetTask()->reset();
-                    while (true) {
-                        vTaskDelay(100 / portTICK_PERIOD_MS);
-                    }
+                    if (!saveSetting())
+                        return;
+
+                    // tasks apply the changes themselves (new SSID reconnects the STA),
+                    // the STA is started again only when it was stopped
+                    _wifiSelector->stopPeriodicScan();
+                    auto *wifi = Application::getInstance()->getWifiTask();
+                    if (wifi->mode() != WifiTask::Mode::Client)
+                        wifi->switchMode(WifiTask::Mode::Client);
+                    ScreenManager::getInstance()->showScreenByType(ScreenType::Main);
                  }},
                 {"Run WiFi AP for setup", lv_color_hex(0x000000), lv_color_hex(UIStyle::Green), [this]()
                  {
@@ -82,21 +87,25 @@ bool SettingScreen::init()
         _buttonPanel = std::make_unique<ButtonPanel>(_screen, _buttonFields, 350, 230, 430, 230);
 
        
-        KeyVal& kv = KeyVal::getInstance();		
+        const Config cfg = ConfigStore::getInstance().get();
 
         std::vector<InputField> fields = {
-            {literals::kv_ssid, "SSID:", kv.readString(literals::kv_ssid,"myAP"), 20, lv_color_hex(UIStyle::LtRed), false},
-            {literals::kv_passwd, "Password:", kv.readString(literals::kv_passwd,""), 20, lv_color_hex(UIStyle::LtRed), true},
-            {literals::kv_mqtt, "Mqtt broker:", kv.readString(literals::kv_mqtt,"192.168.1.20"), 30, lv_color_hex(UIStyle::LtRed), false},
-            {literals::kv_topic, "Mqtt topic:", kv.readString(literals::kv_topic,"solax/data"), 30, lv_color_hex(UIStyle::LtRed), false},
-            { literals::kv_timezone, "Timezone:", kv.readString(literals::kv_timezone,literals::kv_def_timezone), 30, lv_color_hex(UIStyle::White), false},
-            {literals::kv_timeserver, "Time servert (NTP):", kv.readString(literals::kv_timeserver,literals::kv_def_timeserver), 30, lv_color_hex(UIStyle::White), false},
-            {literals::kv_ip, "IP:", kv.readString(literals::kv_ip,""), 20, lv_color_hex(UIStyle::White), false},
-            {literals::kv_mask, "Mask:", kv.readString(literals::kv_mask,""), 40, lv_color_hex(UIStyle::White), false},
-            {literals::kv_gtw, "Gateway:", kv.readString(literals::kv_gtw,""), 20, lv_color_hex(UIStyle::White), false},
-            {literals::kv_dns, "Dns:", kv.readString(literals::kv_dns,""), 30, lv_color_hex(UIStyle::White), false},   
-            {literals::kv_user, "Mqtt user:", kv.readString(literals::kv_user,""), 30, lv_color_hex(UIStyle::White), false},
-            {literals::kv_passwdbr, "Mqtt password:", kv.readString(literals::kv_passwdbr,""), 30, lv_color_hex(UIStyle::White), false} 
+            {literals::kv_ssid, "SSID:", cfg.ssid, 20, lv_color_hex(UIStyle::LtRed), false},
+            {literals::kv_passwd, "Password:", cfg.passwd, 20, lv_color_hex(UIStyle::LtRed), true},
+            {literals::kv_mqtt, "Mqtt broker:", cfg.mqtt, 30, lv_color_hex(UIStyle::LtRed), false},
+            {literals::kv_topic, "Mqtt topics:", cfg.topic, 30, lv_color_hex(UIStyle::LtRed), false},
+            {literals::kv_pubtopic, "Publish topic:", cfg.pubTopic, 30, lv_color_hex(UIStyle::White), false},
+            {literals::kv_pubint, "Publish interval [s]:", cfg.value(literals::kv_pubint), 10, lv_color_hex(UIStyle::White), false},
+            {literals::kv_ckpt, "Checkpoint [min]:", cfg.value(literals::kv_ckpt), 10, lv_color_hex(UIStyle::White), false},
+            {literals::kv_power, "Power profile:", cfg.power, 20, lv_color_hex(UIStyle::White), false},
+            { literals::kv_timezone, "Timezone:", cfg.timezone, 30, lv_color_hex(UIStyle::White), false},
+            {literals::kv_timeserver, "Time servert (NTP):", cfg.timeserver, 30, lv_color_hex(UIStyle::White), false},
+            {literals::kv_ip, "IP:", cfg.ip, 20, lv_color_hex(UIStyle::White), false},
+            {literals::kv_mask, "Mask:", cfg.mask, 40, lv_color_hex(UIStyle::White), false},
+            {literals::kv_gtw, "Gateway:", cfg.gw, 20, lv_color_hex(UIStyle::White), false},
+            {literals::kv_dns, "Dns:", cfg.dns, 30, lv_color_hex(UIStyle::White), false},   
+            {literals::kv_user, "Mqtt user:", cfg.user, 30, lv_color_hex(UIStyle::White), false},
+            {literals::kv_passwdbr, "Mqtt password:", cfg.passwdbr, 30, lv_color_hex(UIStyle::White), false} 
             };
 
         _inputArea = std::make_unique<ScrollableInputArea>(_screen, fields, 200, 400, 450, 10, 10);
@@ -106,23 +115,31 @@ bool SettingScreen::init()
     return rc;
 }
 
-void SettingScreen::saveSetting()
+bool SettingScreen::saveSetting()
 {
-    KeyVal& kv = KeyVal::getInstance();
-    
-
-    kv.writeString(literals::kv_passwd, _inputArea->getInputContent(literals::kv_passwd));
-    kv.writeString(literals::kv_ip, _inputArea->getInputContent(literals::kv_ip));
-    kv.writeString(literals::kv_mask, _inputArea->getInputContent(literals::kv_mask));
-    kv.writeString(literals::kv_gtw, _inputArea->getInputContent(literals::kv_gtw));
-    kv.writeString(literals::kv_ssid, _inputArea->getInputContent(literals::kv_ssid));
-    kv.writeString(literals::kv_dns, _inputArea->getInputContent(literals::kv_dns));
-    kv.writeString(literals::kv_mqtt, _inputArea->getInputContent(literals::kv_mqtt));
-    kv.writeString(literals::kv_user, _inputArea->getInputContent(literals::kv_user));
-    kv.writeString(literals::kv_passwdbr, _inputArea->getInputContent(literals::kv_passwdbr));
-    kv.writeString(literals::kv_topic, _inputArea->getInputContent(literals::kv_topic));
-    kv.writeString(literals::kv_timezone, _inputArea->getInputContent(literals::kv_timezone));
-    kv.writeString(literals::kv_timeserver, _inputArea->getInputContent(literals::kv_timeserver));
+    Config cfg = ConfigStore::getInstance().get();
+    for (const auto &f : Config::fields)
+    {
+        cfg.set(f.key, _inputArea->getInputContent(f.key));
+    }
+
+    // not a number is rejected here, the range by the validation
+    const char *reason = nullptr;
+    for (const char *key : Config::numbers)
+    {
+        if (!reason && !cfg.set(key, _inputArea->getInputContent(key)))
+            reason = key;
+    }
+
+    // validated, one commit, unchanged values are not written
+    if (reason || !ConfigStore::getInstance().update(cfg, &reason))
+    {
+        std::string msg = "Invalid setting: ";
+        msg += reason;
+        Application::getInstance()->getDisplayTask()->settingMsg(msg);
+        return false;
+    }
+    return true;
 }
 
 void SettingScreen::down()
@@ -150,17 +167,19 @@ void SettingScreen::show()
         if (!_started) 
         {
              auto cm = ScreenManager::getInstance()->getConnectionManager();
-             ESP_LOGI(TAG, "Check conneciton manager isXXX");
-             while (cm->isConnected() || cm->isAPActive()) {
-                 vTaskDelay(100 / portTICK_PERIOD_MS);
+             // scanner shares the radio with the STA, but not with the setup AP (LVGL lock is held)
+             if (!cm->waitForClear(ConnectionManager::AP, pdMS_TO_TICKS(10000)))
+             {
+                 ESP_LOGW(TAG, "Setup AP still active, scanning anyway");
              }
 
             vTaskDelay(1000 / portTICK_PERIOD_MS);
-            ESP_LOGI(TAG, "Start scanner");
-           
-            _wifiSelector->startPeriodicScan();
             _started = true;
         }
+
+        // the screen is shown again without reboot, the scan was stopped when it was left
+        ESP_LOGI(TAG, "Start scanner");
+        _wifiSelector->startPeriodicScan();
     }
 }
 
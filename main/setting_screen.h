@@ -25,7 +25,7 @@ private:
     std::shared_ptr<std::vector<ButtonField>> _buttonFields;
     bool _backgroudTog {true};
     bool _started {false};
-    void saveSetting();
+    bool saveSetting();
 
 public:
     
@@ -5,6 +5,8 @@
 /// @file   shoelace.h  Shoelace formula
 /// @author Petr Vanek
 
+#pragma once
+
 #include <array>
 #include <time.h>
 #include <stdio.h>
@@ -33,6 +35,14 @@ public:
     
     using ChartUpdateCallback = std::function<void(int hour, float consumption)>;
 
+    /// @brief Plain accumulator state (used by the checkpoint)
+    struct State
+    {
+        std::array<float, 24> hourlyConsumption{};
+        float lastPower{0};
+        time_t lastUpdateTime{0};
+    };
+
     Shoelace(const std::string &id) : instanceId(id) {
         resetDailyConsumption();
     }
@@ -68,6 +78,18 @@ public:
         hourlyConsumption.fill(0); 
     }
 
+    State state() const
+    {
+        return {hourlyConsumption, lastPower, lastUpdateTime};
+    }
+
+    void restore(const State &st)
+    {
+        hourlyConsumption = st.hourlyConsumption;
+        lastPower = st.lastPower;
+        lastUpdateTime = st.lastUpdateTime;
+    }
+
     void dump()
     {
         ESP_LOGI(TAG,"Hourly Consumption (Wh):");
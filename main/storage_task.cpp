@@ -0,0 +1,363 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   storage_task.cpp
+/// @author Petr Vanek
+
+#include <stdio.h>
+#include <cstring>
+#include <inttypes.h>
+#include <algorithm>
+#include <memory>
+#include "storage_task.h"
+#include "application.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "literals.h"
+
+StorageTask::StorageTask() : _sdcard(literals::sd_mount, HW_SD_MOSI, HW_SD_MISO, HW_SD_CLK, HW_SD_CS, HW_SD_FREQ_KHZ)
+{
+	_queue = xQueueCreate(16, sizeof(StorageTask::Command));
+}
+
+StorageTask::~StorageTask()
+{
+	done();
+	if (_queue)
+		vQueueDelete(_queue);
+}
+
+void StorageTask::setSyncPolicy(SyncPolicy policy, uint32_t flushIntervalMs, size_t maxPendingBytes)
+{
+	_policy = policy;
+	_flushIntervalMs = flushIntervalMs;
+	_maxPendingBytes = maxPendingBytes;
+}
+
+void StorageTask::loop()
+{
+	_mounted = (_sdcard.mount(true) == ESP_OK);
+	if (!_mounted)
+		ESP_LOGE(TAG, "SD card mount failed - memory mode");
+	else
+		ESP_LOGW(TAG, "SD card mode active");
+
+	if (_mounted && literals::sd_benchmark)
+		_sdcard.benchmark();
+
+	Application::getInstance()->signalTaskStart(Application::TaskBit::Storage);
+
+	int64_t lastMetrics = esp_timer_get_time();
+
+	while (true)
+	{
+		// sleep until the next command or until the write-behind deadline
+		TickType_t wait = pdMS_TO_TICKS(1000);
+		if (_pendingBytes > 0)
+		{
+			int64_t leftMs = _flushIntervalMs - (esp_timer_get_time() - _pendingSinceUs) / 1000;
+			wait = pdMS_TO_TICKS(std::clamp<int64_t>(leftMs, 0, 1000));
+		}
+
+		Command cmd;
+		if (xQueueReceive(_queue, &cmd, wait) == pdTRUE)
+		{
+			process(cmd);
+		}
+
+		if (_pendingBytes > 0 &&
+			(_pendingBytes >= _maxPendingBytes || (esp_timer_get_time() - _pendingSinceUs) / 1000 >= _flushIntervalMs))
+		{
+			flushPending();
+		}
+
+		if (esp_timer_get_time() - lastMetrics >= 5 * 60 * 1000000LL)
+		{
+			lastMetrics = esp_timer_get_time();
+			logMetrics();
+		}
+	}
+
+	_sdcard.unmount(); // never umnounted!!!
+}
+
+void StorageTask::process(Command &cmd)
+{
+	std::string path(cmd.path);
+
+	if (!_mounted)
+	{
+		if (cmd.callback)
+			(*cmd.callback)(false, std::string());
+		if (cmd.benchCallback)
+			(*cmd.benchCallback)(false, SdCard::Benchmark{});
+		delete cmd.data;
+		delete cmd.callback;
+		delete cmd.benchCallback;
+		return;
+	}
+
+	switch (cmd.op)
+	{
+	case Op::Write:
+		if (_pendingBytes == 0)
+			_pendingSinceUs = esp_timer_get_time();
+		_pendingBytes -= std::min<uint32_t>(_pendingBytes, _pendingWrite[path].size());
+		_pendingBytes += cmd.data->size();
+		_pendingWrite[path] = std::move(*cmd.data);
+		// content replaced - older records to append are obsolete
+		if (auto it = _pendingAppend.find(path); it != _pendingAppend.end())
+		{
+			_pendingBytes -= std::min<uint32_t>(_pendingBytes, it->second.size());
+			_pendingAppend.erase(it);
+		}
+		break;
+
+	case Op::Append:
+		if (_pendingBytes == 0)
+			_pendingSinceUs = esp_timer_get_time();
+		_pendingBytes += cmd.data->size();
+		if (auto it = _pendingWrite.find(path); it != _pendingWrite.end())
+			it->second += *cmd.data;
+		else
+			_pendingAppend[path] += *cmd.data;
+		break;
+
+	case Op::Rotate:
+		flushPending();
+		_sdcard.deleteFile(path);
+		break;
+
+	case Op::Delete:
+		if (auto it = _pendingWrite.find(path); it != _pendingWrite.end())
+		{
+			_pendingBytes -= std::min<uint32_t>(_pendingBytes, it->second.size());
+			_pendingWrite.erase(it);
+		}
+		if (auto it = _pendingAppend.find(path); it != _pendingAppend.end())
+		{
+			_pendingBytes -= std::min<uint32_t>(_pendingBytes, it->second.size());
+			_pendingAppend.erase(it);
+		}
+		_sdcard.deleteFile(path);
+		break;
+
+	case Op::Read:
+	{
+		// reader must see the data still held in the write-behind buffer
+		flushFile(path);
+		int64_t start = esp_timer_get_time();
+		std::string content = _sdcard.readFile(path);
+		ESP_LOGI(TAG, "Read %s %u B in %" PRId64 " us", path.c_str(), (unsigned)content.size(), esp_timer_get_time() - start);
+		if (cmd.callback)
+			(*cmd.callback)(!content.empty(), std::move(content));
+		break;
+	}
+
+	case Op::Flush:
+		flushPending();
+		break;
+
+	case Op::Benchmark:
+	{
+		flushPending();
+		auto res = _sdcard.benchmark();
+		if (cmd.benchCallback)
+			(*cmd.benchCallback)(res.writeMBs > 0 && res.readMBs > 0 && res.appends > 0, res);
+		break;
+	}
+	}
+
+	delete cmd.data;
+	delete cmd.callback;
+	delete cmd.benchCallback;
+
+	if (_policy == SyncPolicy::Always)
+		flushPending();
+}
+
+void StorageTask::flushFile(const std::string &path)
+{
+	bool sync = (_policy != SyncPolicy::None);
+
+	if (auto it = _pendingWrite.find(path); it != _pendingWrite.end())
+	{
+		int64_t start = esp_timer_get_time();
+		measure(start, _sdcard.writeFile(path, it->second, sync));
+		_pendingBytes -= std::min<uint32_t>(_pendingBytes, it->second.size());
+		_pendingWrite.erase(it);
+	}
+
+	if (auto it = _pendingAppend.find(path); it != _pendingAppend.end())
+	{
+		int64_t start = esp_timer_get_time();
+		measure(start, _sdcard.appendFile(path, it->second, sync));
+		_pendingBytes -= std::min<uint32_t>(_pendingBytes, it->second.size());
+		_pendingAppend.erase(it);
+	}
+}
+
+void StorageTask::flushPending()
+{
+	while (!_pendingWrite.empty())
+	{
+		flushFile(_pendingWrite.begin()->first);
+	}
+
+	while (!_pendingAppend.empty())
+	{
+		flushFile(_pendingAppend.begin()->first);
+	}
+
+	_pendingBytes = 0;
+}
+
+void StorageTask::measure(int64_t startUs, bool ok)
+{
+	uint32_t us = static_cast<uint32_t>(esp_timer_get_time() - startUs);
+	if (!ok)
+	{
+		_failed++;
+		return;
+	}
+
+	_writes++;
+	_lastWriteUs = us;
+	if (us > _maxWriteUs)
+		_maxWriteUs = us;
+	_sumWriteUs += us;
+	_avgWriteUs = static_cast<uint32_t>(_sumWriteUs / _writes);
+}
+
+StorageTask::Metrics StorageTask::metrics() const
+{
+	Metrics m;
+	m.queueDepth = _queue ? uxQueueMessagesWaiting(_queue) : 0;
+	m.maxQueueDepth = _maxQueueDepth;
+	m.dropped = _dropped;
+	m.writes = _writes;
+	m.failed = _failed;
+	m.pendingBytes = _pendingBytes;
+	m.lastWriteUs = _lastWriteUs;
+	m.maxWriteUs = _maxWriteUs;
+	m.avgWriteUs = _avgWriteUs;
+	return m;
+}
+
+void StorageTask::logMetrics()
+{
+	auto m = metrics();
+	ESP_LOGI(TAG, "queue %" PRIu32 " (max %" PRIu32 ", dropped %" PRIu32 ") writes %" PRIu32 " failed %" PRIu32 " pending %" PRIu32 " B latency last %" PRIu32 " avg %" PRIu32 " max %" PRIu32 " us",
+			 m.queueDepth, m.maxQueueDepth, m.dropped, m.writes, m.failed, m.pendingBytes, m.lastWriteUs, m.avgWriteUs, m.maxWriteUs);
+}
+
+bool StorageTask::enqueue(Op op, std::string_view path, std::string *data, ReadCallback *callback, BenchmarkCallback *benchCallback)
+{
+	Command cmd;
+	cmd.op = op;
+	cmd.data = data;
+	cmd.callback = callback;
+	cmd.benchCallback = benchCallback;
+
+	size_t len = std::min(path.size(), sizeof(cmd.path) - 1);
+	std::memcpy(cmd.path, path.data(), len);
+	cmd.path[len] = '\0';
+
+	if (!_queue || len != path.size() || xQueueSendToBack(_queue, &cmd, 0) != pdTRUE)
+	{
+		ESP_LOGW(TAG, "Command dropped [%s]", cmd.path);
+		_dropped++;
+		delete data;
+		delete callback;
+		delete benchCallback;
+		return false;
+	}
+
+	uint32_t depth = uxQueueMessagesWaiting(_queue);
+	if (depth > _maxQueueDepth)
+		_maxQueueDepth = depth;
+	return true;
+}
+
+bool StorageTask::write(std::string_view path, std::string data)
+{
+	return enqueue(Op::Write, path, new std::string(std::move(data)), nullptr);
+}
+
+bool StorageTask::append(std::string_view path, std::string data)
+{
+	return enqueue(Op::Append, path, new std::string(std::move(data)), nullptr);
+}
+
+bool StorageTask::rotate(std::string_view path)
+{
+	return enqueue(Op::Rotate, path, nullptr, nullptr);
+}
+
+bool StorageTask::remove(std::string_view path)
+{
+	return enqueue(Op::Delete, path, nullptr, nullptr);
+}
+
+bool StorageTask::read(std::string_view path, ReadCallback callback)
+{
+	return enqueue(Op::Read, path, nullptr, new ReadCallback(std::move(callback)));
+}
+
+bool StorageTask::flush()
+{
+	return enqueue(Op::Flush, "", nullptr, nullptr);
+}
+
+bool StorageTask::benchmark(BenchmarkCallback callback)
+{
+	return enqueue(Op::Benchmark, "", nullptr, nullptr, callback ? new BenchmarkCallback(std::move(callback)) : nullptr);
+}
+
+namespace
+{
+	// result of a sync call, shared with the callback - it may run after the caller timed out
+	template <typename T>
+	struct SyncResult {
+		SemaphoreHandle_t done{xSemaphoreCreateBinary()};
+		bool ok{false};
+		T value{};
+		~SyncResult() { if (done) vSemaphoreDelete(done); }
+	};
+}
+
+bool StorageTask::readSync(std::string_view path, std::string &content, TickType_t wait)
+{
+	auto res = std::make_shared<SyncResult<std::string>>();
+	if (!res->done || !read(path, [res](bool ok, std::string &&data)
+							{
+		res->ok = ok;
+		res->value = std::move(data);
+		xSemaphoreGive(res->done); }))
+		return false;
+
+	if (xSemaphoreTake(res->done, wait) != pdTRUE)
+	{
+		ESP_LOGW(TAG, "Read %.*s timed out", (int)path.size(), path.data());
+		return false;
+	}
+	content = std::move(res->value);
+	return res->ok;
+}
+
+bool StorageTask::benchmarkSync(SdCard::Benchmark &result, TickType_t wait)
+{
+	auto res = std::make_shared<SyncResult<SdCard::Benchmark>>();
+	if (!res->done || !benchmark([res](bool ok, const SdCard::Benchmark &bench)
+								 {
+		res->ok = ok;
+		res->value = bench;
+		xSemaphoreGive(res->done); }))
+		return false;
+
+	if (xSemaphoreTake(res->done, wait) != pdTRUE)
+		return false;
+	result = res->value;
+	return res->ok;
+}
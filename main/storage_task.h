@@ -0,0 +1,141 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   storage_task.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <map>
+#include <atomic>
+#include <string>
+#include <functional>
+#include "hardware.h"
+#include "rptask.h"
+#include "sd_card.h"
+
+/// @brief SD card owner. All FAT/SPI I/O runs here, callers only enqueue commands,
+/// so a slow or stalled card never blocks the display loop.
+class StorageTask : public RPTask
+{
+public:
+	/// @brief fsync policy
+	enum class SyncPolicy {
+		None,		// write-behind, data reach the card on fclose
+		Flush,		// write-behind, fsync after each flushed file
+		Always		// no write-behind, each command is written and synced immediately
+	};
+
+	/// @brief Completion callback of read(), called from the storage task
+	using ReadCallback = std::function<void(bool ok, std::string &&content)>;
+
+	/// @brief Completion callback of benchmark(), called from the storage task
+	using BenchmarkCallback = std::function<void(bool ok, const SdCard::Benchmark &result)>;
+
+	/// @brief Storage statistics
+	struct Metrics {
+		uint32_t queueDepth;		///< commands waiting in the queue
+		uint32_t maxQueueDepth;		///< maximum observed queue depth
+		uint32_t dropped;			///< commands rejected - queue full
+		uint32_t writes;			///< number of file writes
+		uint32_t failed;			///< failed file operations
+		uint32_t pendingBytes;		///< bytes held by write-behind buffers
+		uint32_t lastWriteUs;		///< latency of the last write
+		uint32_t maxWriteUs;		///< maximum write latency
+		uint32_t avgWriteUs;		///< average write latency
+	};
+
+	StorageTask();
+	virtual ~StorageTask();
+
+	/// @brief Sets fsync policy and write-behind limits, call before init
+	void setSyncPolicy(SyncPolicy policy, uint32_t flushIntervalMs = 10000, size_t maxPendingBytes = 8192);
+
+	/// @brief true if the card is mounted (valid after TaskBit::Storage is signaled)
+	bool isMounted() const { return _mounted; }
+
+	/// @brief Replace file content
+	bool write(std::string_view path, std::string data);
+
+	/// @brief Append record at the end of the file
+	bool append(std::string_view path, std::string data);
+
+	/// @brief Day rotation - flush all pending data and delete the stale file of the new day
+	bool rotate(std::string_view path);
+
+	/// @brief Delete file (pending data for the file are dropped)
+	bool remove(std::string_view path);
+
+	/// @brief Read whole file, callback is called from the storage task
+	bool read(std::string_view path, ReadCallback callback);
+
+	/// @brief Flush all write-behind buffers
+	bool flush();
+
+	/// @brief Run the card throughput benchmark, result is logged
+	bool benchmark(BenchmarkCallback callback = {});
+
+	/// @brief read() waiting for the result, not for the storage task itself
+	/// @return false - not queued, timeout or read failed
+	bool readSync(std::string_view path, std::string &content, TickType_t wait = pdMS_TO_TICKS(5000));
+
+	/// @brief benchmark() waiting for the result, not for the storage task itself
+	bool benchmarkSync(SdCard::Benchmark &result, TickType_t wait = pdMS_TO_TICKS(30000));
+
+	Metrics metrics() const;
+
+protected:
+	void loop() override;
+
+private:
+	enum class Op : uint8_t {
+		Write,
+		Append,
+		Rotate,
+		Delete,
+		Read,
+		Flush,
+		Benchmark
+	};
+
+	// queue item, payload and callback are heap owned and released by the storage task
+	struct Command {
+		Op op;
+		char path[32];
+		std::string *data;
+		ReadCallback *callback;
+		BenchmarkCallback *benchCallback;
+	};
+
+	bool enqueue(Op op, std::string_view path, std::string *data, ReadCallback *callback, BenchmarkCallback *benchCallback = nullptr);
+	void process(Command &cmd);
+	void flushPending();
+	void flushFile(const std::string &path);
+	void measure(int64_t startUs, bool ok);
+	void logMetrics();
+
+private:
+	static constexpr const char *TAG = "StorageTask";
+	QueueHandle_t 	_queue;
+	SdCard			_sdcard;
+	std::atomic<bool> _mounted{false};
+
+	SyncPolicy		_policy{SyncPolicy::Flush};
+	uint32_t		_flushIntervalMs{10000};
+	size_t			_maxPendingBytes{8192};
+
+	std::map<std::string, std::string> _pendingWrite;	///< path -> new content
+	std::map<std::string, std::string> _pendingAppend;	///< path -> records to append
+	std::atomic<uint32_t> _pendingBytes{0};
+	int64_t			_pendingSinceUs{0};
+
+	std::atomic<uint32_t> _maxQueueDepth{0};
+	std::atomic<uint32_t> _dropped{0};
+	std::atomic<uint32_t> _writes{0};
+	std::atomic<uint32_t> _failed{0};
+	std::atomic<uint32_t> _lastWriteUs{0};
+	std::atomic<uint32_t> _maxWriteUs{0};
+	std::atomic<uint32_t> _avgWriteUs{0};
+	uint64_t		_sumWriteUs{0};
+};
@@ -13,7 +13,7 @@
 #include <ctype.h>
 #include "time_task.h"
 #include "esp_log.h"
-#include "key_val.h"
+#include "config.h"
 #include "literals.h"
 #include "application.h"
 #include "esp_sntp.h"
@@ -31,8 +31,7 @@ TimeTask::~TimeTask()
 
 void TimeTask::initializeSNTP()
 {
-  KeyVal &kv = KeyVal::getInstance();
-	_timeserver = kv.readString(literals::kv_timeserver, literals::kv_def_timeserver);
+  _timeserver = ConfigStore::getInstance().get().timeserver;
 
   sntp_setoperatingmode(SNTP_OPMODE_POLL);
   sntp_setservername(0,  _timeserver.c_str()); 
@@ -70,8 +69,7 @@ bool  TimeTask::syncTime()
   {
     time_t now = time(NULL);
     struct tm timeinfo;
-    KeyVal &kv = KeyVal::getInstance();
-    const auto zone = kv.readString(literals::kv_timezone, literals::kv_def_timezone);
+    const auto zone = ConfigStore::getInstance().get().timezone;
     updateTimeZone(zone.c_str());
     localtime_r(&now, &timeinfo);
     ESP_LOGW(LOG_TAG, "Time synchronized: %s status=%d   zone [%s]", asctime(&timeinfo),status, zone.c_str());
@@ -101,9 +99,40 @@ void TimeTask::loop()
     int syncIntervalMs = 3600; // in ms
     int64_t lastSyncTime = esp_timer_get_time();
     bool initialSyncDone = false;
+    int64_t reconfigStart = 0;
+
+    // the loop sleeps until WiFi changes, the settings change or the next sync is due
+    ConfigStore::getInstance().subscribe(Config::Time, [this](const Config &, uint32_t)
+                                         {
+                                             _reconfigure = true;
+                                             xTaskNotifyGive(task()); });
+    if (_connectionManager)
+        _connectionManager->onChange(ConnectionManager::Wifi, [this](EventBits_t, EventBits_t)
+                                     { xTaskNotifyGive(task()); });
 
     while (true)
     {
+        if (_reconfigure.exchange(false))
+        {
+            const Config cfg = ConfigStore::getInstance().get();
+            updateTimeZone(cfg.timezone.c_str());
+
+            if (cfg.timeserver != _timeserver && sntp_enabled())
+            {
+                // SNTP keeps the pointer to the name, stop it before the string changes
+                sntp_stop();
+                _timeserver = cfg.timeserver;
+                sntp_setservername(0, _timeserver.c_str());
+                sntp_init();
+                ESP_LOGI(LOG_TAG, "NTP server changed [%s]", _timeserver.c_str());
+                reconfigStart = esp_timer_get_time();
+            }
+
+            // check the new setting soon
+            syncIntervalMs = 1000;
+            lastSyncTime = esp_timer_get_time();
+        }
+
         if (_connectionManager && _connectionManager->isConnected())
         {
             if (!initialSyncDone)
@@ -125,11 +154,17 @@ void TimeTask::loop()
                 ESP_LOGI(LOG_TAG, "Syncing time...");
                 if (!syncTime())
                 {
-                      // wait more time
-                      syncIntervalMs = 10000;
-                      ESP_LOGI(LOG_TAG, "Wait more time");
+                      // wait more time, longer after each failure
+                      syncIntervalMs = _backoff.next();
+                      ESP_LOGI(LOG_TAG, "Wait more time, %d ms (%lu attempts in the last hour)", syncIntervalMs, (unsigned long)_backoff.attemptsLastHour());
                 } else {
-                    syncIntervalMs = 1000000;                    
+                    syncIntervalMs = 1000000;
+                    _backoff.reset();
+                    if (reconfigStart)
+                    {
+                        ESP_LOGI(LOG_TAG, "Synchronized %lld ms after reconfiguration", (long long)(esp_timer_get_time() - reconfigStart) / 1000);
+                        reconfigStart = 0;
+                    }
                 }
 
                 lastSyncTime = esp_timer_get_time();
@@ -141,9 +176,16 @@ void TimeTask::loop()
             {
                 ESP_LOGW(LOG_TAG, "Wi-Fi disconnected. Waiting for reconnection...");
                 initialSyncDone = false;
+                _backoff.reset();
             }
         }
 
-        vTaskDelay(pdMS_TO_TICKS(1000)); // Check every second
+        TickType_t wait = portMAX_DELAY;
+        if (initialSyncDone)
+        {
+            int64_t left = syncIntervalMs - (esp_timer_get_time() - lastSyncTime) / 1000;
+            wait = left > 0 ? pdMS_TO_TICKS(left + 1) : 0;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
     }
 }
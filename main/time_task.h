@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <atomic>
 #include "hardware.h"
 #include "rptask.h"
 #include "connection_manager.h"
+#include "backoff.h"
+#include "literals.h"
 
 
 
@@ -30,5 +33,7 @@ private:
 	static constexpr const char *LOG_TAG = "TIME";
 	std::shared_ptr<ConnectionManager> _connectionManager;
 	std::string _timeserver;
+	std::atomic<bool> _reconfigure{false};
+	Backoff _backoff{literals::sntp_backoff_base_ms, literals::sntp_backoff_cap_ms};
 
 };
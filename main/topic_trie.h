@@ -0,0 +1,196 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   topic_trie.h
+/// @author Petr Vanek
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <functional>
+
+/// @brief MQTT topic filters (with + and # wildcards) compiled into a trie of levels.
+/// A topic is routed by walking its levels once, every level is a map lookup plus
+/// the + and # branches, so the cost depends on the topic depth, not on the number
+/// of filters. Topics are matched as string_view, nothing is copied.
+/// Handler is a std::function like type, an empty handler means no filter.
+template <typename Handler>
+class TopicTrie
+{
+public:
+    TopicTrie() = default;
+
+    TopicTrie(TopicTrie const &) = delete;
+    void operator=(TopicTrie const &) = delete;
+
+    /// @brief Checks filter syntax: + and # take a whole level, # only the last one
+    static bool isValidFilter(std::string_view filter)
+    {
+        if (filter.empty())
+            return false;
+
+        size_t start = 0;
+        while (true)
+        {
+            size_t end = filter.find('/', start);
+            std::string_view level = filter.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+
+            if (level.find_first_of("+#") != std::string_view::npos && level.size() != 1)
+                return false;
+            if (level == "#" && end != std::string_view::npos)
+                return false;
+            if (end == std::string_view::npos)
+                return true;
+            start = end + 1;
+        }
+    }
+
+    /// @brief Adds or replaces the handler of the filter
+    /// @return false - invalid filter
+    bool insert(std::string_view filter, Handler handler)
+    {
+        if (!isValidFilter(filter))
+            return false;
+
+        Node *node = &_root;
+        forEachLevel(filter, [&node](std::string_view level)
+                     {
+            std::unique_ptr<Node> *child;
+            if (level == "+")
+                child = &node->plus;
+            else if (level == "#")
+                child = &node->hash;
+            else
+            {
+                auto it = node->children.find(level);
+                if (it == node->children.end())
+                    it = node->children.emplace(std::string(level), nullptr).first;
+                child = &it->second;
+            }
+
+            if (!*child)
+                *child = std::make_unique<Node>();
+            node = child->get(); });
+
+        if (!node->handler)
+            _size++;
+        node->handler = std::move(handler);
+        return true;
+    }
+
+    /// @brief Removes the handler of the filter, empty branches are kept
+    /// @return false - filter not registered
+    bool erase(std::string_view filter)
+    {
+        Node *node = &_root;
+        forEachLevel(filter, [&node](std::string_view level)
+                     {
+            if (!node)
+                return;
+            if (level == "+")
+                node = node->plus.get();
+            else if (level == "#")
+                node = node->hash.get();
+            else
+            {
+                auto it = node->children.find(level);
+                node = (it == node->children.end()) ? nullptr : it->second.get();
+            } });
+
+        if (!node || !node->handler)
+            return false;
+
+        node->handler = nullptr;
+        _size--;
+        return true;
+    }
+
+    /// @brief Calls visit(handler) for every filter matching the topic
+    /// @return number of matched filters
+    template <typename Visit>
+    int match(std::string_view topic, Visit &&visit) const
+    {
+        if (topic.empty())
+            return 0;
+        // wildcards at the first level do not match $SYS like topics
+        return walk(&_root, topic, 0, !topic.empty() && topic[0] == '$', visit);
+    }
+
+    size_t size() const { return _size; }
+
+    void clear()
+    {
+        _root = Node();
+        _size = 0;
+    }
+
+private:
+    struct Node
+    {
+        std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+        std::unique_ptr<Node> plus;
+        std::unique_ptr<Node> hash;
+        Handler handler{};
+    };
+
+    template <typename F>
+    static void forEachLevel(std::string_view str, F &&f)
+    {
+        size_t start = 0;
+        while (true)
+        {
+            size_t end = str.find('/', start);
+            if (end == std::string_view::npos)
+            {
+                f(str.substr(start));
+                return;
+            }
+            f(str.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    /// @param pos start of the current level, npos - all levels consumed
+    template <typename Visit>
+    static int walk(const Node *node, std::string_view topic, size_t pos, bool noWildcard, Visit &visit)
+    {
+        int matched = 0;
+
+        // "a/#" matches "a" as well as everything below it
+        if (node->hash && node->hash->handler && !noWildcard)
+        {
+            visit(node->hash->handler);
+            matched++;
+        }
+
+        if (pos == std::string_view::npos)
+        {
+            if (node->handler)
+            {
+                visit(node->handler);
+                matched++;
+            }
+            return matched;
+        }
+
+        size_t end = topic.find('/', pos);
+        std::string_view level = topic.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+        size_t next = (end == std::string_view::npos) ? std::string_view::npos : end + 1;
+
+        auto it = node->children.find(level);
+        if (it != node->children.end())
+            matched += walk(it->second.get(), topic, next, false, visit);
+
+        if (node->plus && !noWildcard)
+            matched += walk(node->plus.get(), topic, next, false, visit);
+
+        return matched;
+    }
+
+    Node _root;
+    size_t _size{0};
+};
@@ -237,4 +237,8 @@ void ScreenManager::updateDataSetHour(int datasetIndex, int hour, int newValue)
     }
 }
 
-
+void ScreenManager::backLight(bool on)
+{
+    ESP_LOGI(TAG, "Backlight %s", on ? "on" : "off");
+    _dd.backLight(on);
+}
@@ -105,6 +105,11 @@ public:
      void clearAllDataSets();
     void updateDataSetHour(int datasetIndex, int hour, int newValue);
 
+    /**
+     * @brief Switches the LCD backlight (CH422G DISP output, on/off only).
+     */
+    void backLight(bool on);
+
 };
 
 /**
@@ -7,6 +7,40 @@
 
 #pragma once
 
+/// @brief Aggregated energy KPIs for one period (day or month).
+/// Energies are double - a month reaches ~1e6 Wh where the float step (0.06 Wh)
+/// is comparable with one sample (0.1..3 Wh).
+struct EnergyKpi
+{
+    double pvWh{0};            ///< Photovoltaic energy produced (Wh).
+    double loadWh{0};          ///< Energy consumed by the house (Wh).
+    double importWh{0};        ///< Energy taken from the grid (Wh).
+    double exportWh{0};        ///< Energy fed into the grid (Wh).
+    double battChargeWh{0};    ///< Energy stored into the battery (Wh).
+    double battDischargeWh{0}; ///< Energy delivered by the battery (Wh).
+    float peakPv{0};          ///< Peak photovoltaic power (W).
+    float peakLoad{0};        ///< Peak house load (W).
+    float cycles{0};          ///< Equivalent full battery cycles.
+
+    /// @brief Share of the load covered without the grid (0..100 %).
+    float autarky() const
+    {
+        if (loadWh <= 0)
+            return 0;
+        float v = static_cast<float>((loadWh - importWh) / loadWh * 100.0);
+        return v < 0 ? 0 : (v > 100 ? 100 : v);
+    }
+
+    /// @brief Share of the PV production used locally (0..100 %).
+    float selfConsumption() const
+    {
+        if (pvWh <= 0)
+            return 0;
+        float v = static_cast<float>((pvWh - exportWh) / pvWh * 100.0);
+        return v < 0 ? 0 : (v > 100 ? 100 : v);
+    }
+};
+
 /// @brief Structure to store and transfer solar energy data.
 struct SolarData
 {
@@ -43,6 +77,10 @@ struct SolarData
     bool errorWifi{false}; ///< Wifi not connected
     bool errorMqtt{false}; ///< MQTT error
 
+    // Analytics (see EnergyStats)
+    EnergyKpi kpiDay{};   ///< KPIs of the current day.
+    EnergyKpi kpiMonth{}; ///< KPIs of the current month.
+
     /// @brief Updates the derived values based on primary data.
     void updateDerivedValues()
     {
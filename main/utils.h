@@ -13,6 +13,9 @@
 #include <iomanip>
 #include <cctype>
 #include <string_view>
+#include <array>
+#include <cstdint>
+#include <tuple>
 #include <time.h>
 #include "esp_sntp.h"
 #include "esp_log.h"
@@ -23,40 +26,57 @@ class Utils
 private:
     static constexpr const char *TAG = "UTILS";
 
-public:
-    static std::string urlDecode(std::string_view encoded)
+    // hex digit value, 0xff for anything else
+    static constexpr auto hexNibble = []
     {
-        std::ostringstream decoded;
+        std::array<uint8_t, 256> t{};
+        for (auto &v : t)
+            v = 0xff;
+        for (int i = 0; i < 10; i++)
+            t['0' + i] = i;
+        for (int i = 0; i < 6; i++)
+        {
+            t['a' + i] = 10 + i;
+            t['A' + i] = 10 + i;
+        }
+        return t;
+    }();
 
-        for (size_t i = 0; i < encoded.size(); ++i)
+public:
+    /// @brief URL decode ('+' -> ' ', %XX -> byte), malformed escapes are kept as they are
+    /// @param buf encoded data, decoded in place (output is never longer than input)
+    /// @param len length of the encoded data
+    /// @return length of the decoded data
+    static size_t urlDecodeInPlace(char *buf, size_t len)
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < len; ++i)
         {
-            if (encoded[i] == '%')
+            char c = buf[i];
+            if (c == '+')
             {
-
-                if (i + 2 < encoded.size() && std::isxdigit(encoded[i + 1]) && std::isxdigit(encoded[i + 2]))
+                c = ' ';
+            }
+            else if (c == '%' && i + 2 < len)
+            {
+                uint8_t hi = hexNibble[static_cast<uint8_t>(buf[i + 1])];
+                uint8_t lo = hexNibble[static_cast<uint8_t>(buf[i + 2])];
+                if ((hi | lo) < 16)
                 {
-                    std::string hexValue(encoded.substr(i + 1, 2));
-                    char decodedChar = static_cast<char>(std::stoi(hexValue, nullptr, 16));
-                    decoded << decodedChar;
+                    c = static_cast<char>((hi << 4) | lo);
                     i += 2;
                 }
-                else
-                {
-
-                    decoded << encoded[i];
-                }
-            }
-            else if (encoded[i] == '+')
-            {
-                decoded << ' ';
-            }
-            else
-            {
-                decoded << encoded[i];
             }
+            buf[out++] = c;
         }
+        return out;
+    }
 
-        return decoded.str();
+    static std::string urlDecode(std::string_view encoded)
+    {
+        std::string decoded(encoded);
+        decoded.resize(urlDecodeInPlace(decoded.data(), decoded.size()));
+        return decoded;
     }
 
     static int getCurrentHour()
@@ -11,19 +11,22 @@
 #include <math.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <algorithm>
 #include "application.h"
 #include "web_task.h"
 #include "http_server.h"
-#include "key_val.h"
+#include "config.h"
 #include "content_file.h"
-#include "http_request.h"
+#include "form_parser.h"
 #include <cJSON.h>
 #include "utils.h"
+#include "history_export.h"
 
 WebTask::WebTask()
 {
 	_queue = xQueueCreate(2, sizeof(int));
-	_queueAP = xQueueCreate(2, sizeof(APInfo));
+	// one scan result set and its ClearAPInfo marker
+	_queueAP = xQueueCreate(WiFiScanner::maxResults + 1, sizeof(APInfo));
 }
 
 WebTask::~WebTask()
@@ -43,35 +46,38 @@ void WebTask::loop()
 		.ap_name = "",
 		.rssi = 0
 	};
-	HttpServer server;
 	std::string apinfo;
+	size_t apCount = 0;
+	uint32_t pushedVersion = 0;
 
     Application::getInstance()->signalTaskStart(Application::TaskBit::Web);
 
 	while (true)
 	{ // Loop forever
 		
-		// AP info update - used only in registration
-		auto resap = xQueueReceive(_queueAP, (void *)&apinf, 0);
-		if (resap == pdTRUE)
-		{  
-			if (apinfo.size() > 100) {
-    			apinfo.clear(); 
+		// AP info update - used only in registration, the list is rebuilt after ClearAPInfo
+		while (xQueueReceive(_queueAP, (void *)&apinf, 0) == pdTRUE)
+		{
+			if (!apinf.ap_name[0])
+			{
+				apinfo.clear();
+				apCount = 0;
+				continue;
 			}
 
-			std::string ap_name_to_find = apinf.ap_name;
-    		if (apinfo.find(ap_name_to_find) == std::string::npos) {
+			// scanner results are unique SSIDs
+			if (apCount >= WiFiScanner::maxResults)
+				continue;
 
-				ESP_LOGI(TAG, "APINF: %s   rssi:%d", apinf.ap_name, apinf.rssi);
-				apinfo += "<li>";
-				apinfo += apinf.ap_name;
-				apinfo += "  RSSI: ";
-				apinfo += std::to_string(apinf.rssi);
-				apinfo += "</li>";
-			}
+			ESP_LOGI(TAG, "APINF: %s   rssi:%d", apinf.ap_name, apinf.rssi);
+			apinfo += "<li>";
+			apinfo += apinf.ap_name;
+			apinfo += "  RSSI: ";
+			apinfo += std::to_string(apinf.rssi);
+			apinfo += "</li>";
+			apCount++;
 		}
-		
-		
+
 		int receivedMode;
 		auto res = xQueueReceive(_queue, (void *)&receivedMode, 0);
 		if (res == pdTRUE)
@@ -80,15 +86,42 @@ void WebTask::loop()
 			if (mode == Mode::Stop)
 			{
 				ESP_LOGI(TAG,"http server mode -> stop");
-				server.stop();
+				_server.stop();
+			}
+			else if (mode == Mode::Client)
+			{
+				ESP_LOGI(TAG,"http server mode -> client");
+				_server.stop();
+				_server.start();
+				registerDataHandlers(_server);
 			}
 			else if (mode == Mode::Setting)
 			{
-				server.stop();
-				server.start();
+				_server.stop();
+				_server.start();
+				registerDataHandlers(_server);
+
+				// card throughput on demand, writes and removes a scratch file (~1 s)
+				// setup mode only - it wears the card and blocks the server meanwhile
+				_server.registerUriHandler("/api/sdbench", HTTP_POST, [](httpd_req_t *req) -> esp_err_t {
+					auto *storage = Application::getInstance()->getStorageTask();
+					SdCard::Benchmark res;
+					if (!storage->isMounted() || !storage->benchmarkSync(res))
+					{
+						httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Benchmark failed");
+						return ESP_FAIL;
+					}
+
+					char json[192];
+					int len = snprintf(json, sizeof(json), "{\"writeMBs\":%.2f,\"readMBs\":%.2f,\"appendAvgUs\":%lu,\"appendMaxUs\":%lu,\"appends\":%lu}",
+									   res.writeMBs, res.readMBs, (unsigned long)res.appendAvgUs, (unsigned long)res.appendMaxUs, (unsigned long)res.appends);
+					httpd_resp_set_type(req, "application/json");
+					httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+					return httpd_resp_send(req, json, len);
+				});
 
 				// AP info
-				server.registerUriHandler("/log", HTTP_GET, [&apinfo](httpd_req_t *req) -> esp_err_t
+				_server.registerUriHandler("/log", HTTP_GET, [&apinfo](httpd_req_t *req) -> esp_err_t
 										  {	
 							httpd_resp_set_type(req, "text/plain");
 							httpd_resp_send(req, apinfo.c_str() , apinfo.length());
@@ -98,117 +131,174 @@ void WebTask::loop()
 
 
 				// AP main page
-				server.registerUriHandler("/", HTTP_GET, [&apinfo](httpd_req_t *req) -> esp_err_t {
-						
-
-						auto replaceAll = [](std::string& str, const std::string& from, const std::string& to) {
-						if(from.empty())
-							return;
-						size_t start_pos = 0;
-						while((start_pos = str.find(from, start_pos)) != std::string::npos) {
-							str.replace(start_pos, from.length(), to);
-							start_pos += to.length(); 
-						}
-					};
+				_server.registerUriHandler("/", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t {
 
-					ConentFile apcnt(literals::kv_fl_ap);	
-					KeyVal& kv = KeyVal::getInstance();			  
-					auto contnetb = apcnt.readContnet();
-					
-					if (contnetb.empty()) {
+					// template is read from flash and split into segments only once
+					if (!_apTemplate.isParsed()) {
+						const auto *tmpl = _assets.get(literals::kv_fl_ap);
+						if (!tmpl || !_apTemplate.parse(std::string_view(reinterpret_cast<const char *>(tmpl->data), tmpl->size))) {
 						    httpd_resp_set_type(req, "text/html");
     						const char* error_message = "Initialize SPIF first! - ap.html";
     						httpd_resp_send(req, error_message, HTTPD_RESP_USE_STRLEN);
-							return ESP_OK;;
+							return ESP_OK;
+						}
 					}
 
-					replaceAll(contnetb, "%SSID%", kv.readString(literals::kv_ssid,"myAP"));
-					replaceAll(contnetb, "%PASS%", kv.readString(literals::kv_passwd,"password"));
-					replaceAll(contnetb, "%IP%", kv.readString(literals::kv_ip,""));
-					replaceAll(contnetb, "%MASK%", kv.readString(literals::kv_mask,""));
-					replaceAll(contnetb, "%GW%", kv.readString(literals::kv_gtw,""));
-					replaceAll(contnetb, "%DNS%", kv.readString(literals::kv_dns,""));
-					replaceAll(contnetb, "%MQTT_BROKER%", kv.readString(literals::kv_mqtt,"192.168.2.20"));
-					replaceAll(contnetb, "%BROKER_USER%", kv.readString(literals::kv_user,""));
-					replaceAll(contnetb, "%BROKER_PASSWD%", kv.readString(literals::kv_passwdbr,""));
-					replaceAll(contnetb, "%TOPIC%", kv.readString(literals::kv_topic,"solax/data"));
-					replaceAll(contnetb, "%TIMEZONE%", kv.readString(literals::kv_timezone,literals::kv_def_timezone));
-					replaceAll(contnetb, "%TIMESERVER%", kv.readString(literals::kv_timeserver,literals::kv_def_timeserver));
-
- 					httpd_resp_send(req, contnetb.c_str(), contnetb.length());
-
-                    return ESP_OK; });
+					// page holds the current settings - never cache it
+					httpd_resp_set_type(req, "text/html");
+					httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+					const Config cfg = ConfigStore::getInstance().get();
+					return _apTemplate.render(req, [&cfg](std::string_view name) { return settingValue(cfg, name); });
+				});
 
-				server.registerUriHandler("/style.css", HTTP_GET, [](httpd_req_t *req) -> esp_err_t
+				_server.registerUriHandler("/style.css", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t
 										  {
-					 httpd_resp_set_type(req, "text/css");
-					 ConentFile ap1cnt(literals::kv_fl_style);
-    				 auto contnet = ap1cnt.readContnet();
-                    httpd_resp_send(req, contnet.c_str(), contnet.length());
-                   
-                    return ESP_OK; });
+					return _assets.send(req, literals::kv_fl_style, "text/css", "public, max-age=86400"); });
 
 				// AP setting answer
-				server.registerUriHandler("/", HTTP_POST, [](httpd_req_t *req) -> esp_err_t {
-					const auto szBuf = 300;
-					 std::unique_ptr<char[], std::default_delete<char[]>> content(new char[szBuf]());
-					int received = httpd_req_recv(req, content.get(), szBuf - 1);
-					ESP_LOGI(TAG,"POST received %d", received);
-
-					if (received >= szBuf - 1) {
-						ESP_LOGE(TAG, "Received data exceeds buffer size");
-						httpd_resp_send_500(req); 
+				_server.registerUriHandler("/", HTTP_POST, [this](httpd_req_t *req) -> esp_err_t {
+					// body is parsed while it is received, each known field is staged for NVS
+					if (!FormParser::isValidLength(req->content_len)) {
+						ESP_LOGE(TAG, "POST size %u not accepted", (unsigned)req->content_len);
+						httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid form size");
 						return ESP_FAIL;
 					}
 
-					if (received <= 0) { 
-						if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-							httpd_resp_send_408(req);
+					// fields not in the form keep the current value
+					Config cfg = ConfigStore::getInstance().get();
+					FormParser parser([&cfg](std::string_view key, std::string_view value) {
+						if (!cfg.set(key, value))
+							ESP_LOGW(TAG, "Unknown or invalid form field %.*s", (int)key.size(), key.data());
+					});
+
+					char chunk[FormParser::recvChunk];
+					size_t remaining = req->content_len;
+					int timeouts = 0;
+					while (remaining > 0) {
+						int received = httpd_req_recv(req, chunk, std::min(remaining, sizeof(chunk)));
+						if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3)
+							continue;
+
+						if (received <= 0) {
+							if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+								httpd_resp_send_408(req);
+							}
+							return ESP_FAIL;
 						}
+
+						parser.feed(chunk, received);
+						remaining -= received;
+					}
+					parser.finish();
+					ESP_LOGI(TAG, "POST %u B, %d fields, %d dropped", (unsigned)req->content_len, parser.pairs(), parser.errors());
+
+					// validated, changed values stored in one NVS commit
+					const char *reason = nullptr;
+					if (!ConfigStore::getInstance().update(cfg, &reason)) {
+						httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, reason);
 						return ESP_FAIL;
 					}
 
-					// parse response & store configuration
-					std::map<std::string, std::string> formData = HttpReqest::parseFormData(std::string(content.get()));
-					KeyVal& kv = KeyVal::getInstance();
-
-					kv.writeString(literals::kv_ssid, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_ssid)).c_str());
-					kv.writeString(literals::kv_passwd, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_passwd)).c_str());
-					kv.writeString(literals::kv_ip, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_ip)).c_str());
-					kv.writeString(literals::kv_mask, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_mask)).c_str());		
-					kv.writeString(literals::kv_gtw, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_gtw)).c_str());
-					kv.writeString(literals::kv_dns, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_dns)).c_str());
-
-					kv.writeString(literals::kv_mqtt, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_mqtt)).c_str());
-					kv.writeString(literals::kv_user, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_user)).c_str());
-					kv.writeString(literals::kv_passwdbr, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_passwdbr)).c_str());
-					kv.writeString(literals::kv_topic, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_topic)).c_str());
-
-					kv.writeString(literals::kv_timezone, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_timezone)).c_str());
-					kv.writeString(literals::kv_timeserver, Utils::urlDecode(HttpReqest::getValue(formData, literals::kv_timeserver)).c_str());
-									
 					// Response
-					auto respContnetDialog = std::make_unique<ConentFile>(literals::kv_fl_finish);	
-    				const auto finish = respContnetDialog->readContnet();
-					if (finish.empty())  {
-						httpd_resp_set_type(req, "text/html");
-    					const char* error_message = "Initialize SPIF first! -  finish.html";
-    					httpd_resp_send(req, error_message, HTTPD_RESP_USE_STRLEN);
+					_assets.send(req, literals::kv_fl_finish, "text/html", "no-cache");
+
+					auto *wifi = Application::getInstance()->getWifiTask();
+					if (wifi->apConcurrent()) {
+						// STA runs next to the setup AP, only the AP is closed (STA reconnects on a new SSID)
+						wifi->switchMode(WifiTask::Mode::Client);
+						Application::getInstance()->getDisplayTask()->showMain();
 					} else {
-						httpd_resp_send(req, finish.c_str(), finish.length());
+						// the setup AP deinitializes the WiFi driver, restart is the way back to STA
+						Application::getInstance()->getResetTask()->reset();
 					}
-					
-					Application::getInstance()->getResetTask()->reset();
 
 					return ESP_OK; 
 				});
 			}
 		}
 
+		// new snapshot for SSE subscribers
+		if (_live.version() != pushedVersion)
+		{
+			pushedVersion = _live.version();
+			_live.push(_server.handle());
+		}
+
 		vTaskDelay(500 / portTICK_PERIOD_MS);
 	}
 }
 
+namespace
+{
+	struct SettingField {
+		std::string_view name;	// placeholder in ap.html
+		const char *key;		// Config field key, also the form field name
+	};
+
+	constexpr SettingField settingFields[] = {
+		{"SSID", literals::kv_ssid},
+		{"PASS", literals::kv_passwd},
+		{"IP", literals::kv_ip},
+		{"MASK", literals::kv_mask},
+		{"GW", literals::kv_gtw},
+		{"DNS", literals::kv_dns},
+		{"MQTT_BROKER", literals::kv_mqtt},
+		{"BROKER_USER", literals::kv_user},
+		{"BROKER_PASSWD", literals::kv_passwdbr},
+		{"TOPIC", literals::kv_topic},
+		{"TIMEZONE", literals::kv_timezone},
+		{"TIMESERVER", literals::kv_timeserver},
+		{"PUB_TOPIC", literals::kv_pubtopic},
+		{"PUB_INTERVAL", literals::kv_pubint},
+		{"CKPT", literals::kv_ckpt},
+		{"POWER", literals::kv_power},
+	};
+}
+
+std::string WebTask::settingValue(const Config &cfg, std::string_view name)
+{
+	for (const auto &f : settingFields)
+	{
+		if (f.name == name)
+			return cfg.value(f.key);
+	}
+
+	ESP_LOGW(TAG, "Unknown placeholder %.*s", (int)name.size(), name.data());
+	return "";
+}
+
+void WebTask::registerDataHandlers(HttpServer &server)
+{
+	// history from SD card, streamed in chunks
+	server.registerUriHandler("/export", HTTP_GET, [](httpd_req_t *req) -> esp_err_t {
+		auto *storage = Application::getInstance()->getStorageTask();
+		if (!storage->isMounted())
+		{
+			httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No SD card");
+			return ESP_FAIL;
+		}
+
+		// reads go through the storage task, the pending write-behind data of a file are written first
+		HistoryExport exp(req, [storage](const std::string &path, std::string &content)
+						  { return storage->readSync(path, content); });
+		return exp.run();
+	});
+
+	// read-only REST API
+	server.registerUriHandler("/api/now", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t {
+		return _live.sendNow(req);
+	});
+
+	server.registerUriHandler("/api/today", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t {
+		return _live.sendToday(req);
+	});
+
+	// Server-Sent Events, each new snapshot is pushed
+	server.registerUriHandler("/api/events", HTTP_GET, [this](httpd_req_t *req) -> esp_err_t {
+		return _live.subscribe(req);
+	});
+}
+
 void WebTask::apInfo(const APInfo &ap)
 {
 	if (_queueAP)
@@ -219,6 +309,13 @@ void WebTask::apInfo(const APInfo &ap)
 
 void WebTask::command(Mode mode)
 {
+	// goes in order with the AP entries, the empty name marks a new list
+	if (mode == Mode::ClearAPInfo)
+	{
+		apInfo(APInfo{});
+		return;
+	}
+
 	if (_queue)
 	{
 		int modeToSend = static_cast<int>(mode);
@@ -12,6 +12,11 @@
 #include "access_point.h"
 #include "literals.h"
 #include "wifi_scanner.h"
+#include "http_server.h"
+#include "asset_cache.h"
+#include "html_template.h"
+#include "live_data.h"
+#include "config.h"
 
 
 class WebTask : public RPTask
@@ -20,21 +25,31 @@ public:
  enum class Mode {
 		ClearAPInfo,
 	    Setting,     	
+		Client,		// STA connected - data endpoints only
         Stop       };
 
 	WebTask();
 	virtual ~WebTask();
 	void command(Mode mode);
 	void apInfo(const APInfo& ap);
+	LiveData &liveData() { return _live; }
 
 protected:
 	void loop() override;
 
+private:
+	void registerDataHandlers(HttpServer &server);
+	static std::string settingValue(const Config &cfg, std::string_view name);
+
 private:
 	static constexpr const char *TAG = "WebTask";
 
 	Mode            _mode {Mode::Stop};
 	QueueHandle_t 	_queue;
 	QueueHandle_t 	_queueAP;
+	AssetCache		_assets;		///< static web content in PSRAM
+	HtmlTemplate	_apTemplate;	///< setting page, parsed on the first request
+	HttpServer		_server;
+	LiveData		_live;			///< snapshot for REST API & SSE
 
 };
@@ -9,17 +9,23 @@
 #pragma once
 
 #include <string>
+#include <cstring>
+#include <algorithm>
 #include <functional>
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
+#include "key_val.h"
+#include "literals.h"
 
 using WiFiConnectedCallback = std::function<void(const ip_event_got_ip_t &)>;
 using WiFiDisconnectedCallback = std::function<void()>;
+using WiFiRssiLowCallback = std::function<void(int rssi)>;
 
 class WiFiClient
 {
@@ -63,16 +69,25 @@ public:
             return false;
         }
 
-        _espNetif = esp_netif_create_default_wifi_sta();
+        // init may be repeated on reconnect with a new configuration
         if (!_espNetif)
         {
-            ESP_LOGE(TAG, "Failed to create default wifi STA");
-            return false;
+            _espNetif = esp_netif_create_default_wifi_sta();
+            if (!_espNetif)
+            {
+                ESP_LOGE(TAG, "Failed to create default wifi STA");
+                return false;
+            }
         }
 
         // callback
-        esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &WiFiClient::eventHandler, this);
-        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &WiFiClient::eventHandler, this);
+        if (!_handlersRegistered)
+        {
+            esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &WiFiClient::eventHandler, this);
+            esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &WiFiClient::eventHandler, this);
+            esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW, &WiFiClient::eventHandler, this);
+            _handlersRegistered = true;
+        }
 
         return true;
     }
@@ -90,7 +105,19 @@ public:
         wifi_config_t wifi_config = {};
         strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
         strncpy((char *)wifi_config.sta.password, pass, sizeof(wifi_config.sta.password));
+
+        // directed association to the last AP skips the scan of all channels
+        _directed = loadCache(ssid, wifi_config.sta.bssid, wifi_config.sta.channel);
+        wifi_config.sta.bssid_set = _directed;
+        wifi_config.sta.scan_method = _directed ? WIFI_FAST_SCAN : WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+        // 802.11k/v, a mesh AP may steer the STA to a better node
+        wifi_config.sta.rm_enabled = 1;
+        wifi_config.sta.btm_enabled = 1;
+        // beacons skipped in modem sleep, 0 - driver default (3)
+        wifi_config.sta.listen_interval = _listenInterval;
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+        ESP_LOGI(TAG, "Connecting to [%s], %s", ssid, _directed ? "cached AP" : "full scan");
 
         // sets DHCP or static IP
         if (!use_dhcp && static_ip != nullptr)
@@ -111,6 +138,9 @@ public:
             return false;
         }
 
+        _gotIp = false;
+        _connectStart = esp_timer_get_time();
+        _stats.attempts++;
         ret = esp_wifi_connect();
         if (ret != ESP_OK)
         {
@@ -122,6 +152,20 @@ public:
         return true;
     }
 
+    /// @brief New connection attempt after the link was lost (WiFi stays started)
+    bool reconnect()
+    {
+        _connectStart = esp_timer_get_time();
+        _stats.attempts++;
+        esp_err_t ret = esp_wifi_connect();
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "esp_wifi_connect failed: %s", esp_err_to_name(ret));
+            return false;
+        }
+        return true;
+    }
+
     bool disconnect()
     {
         if (!_isConnected)
@@ -147,6 +191,7 @@ public:
             ESP_LOGI(TAG, "Destroying existing STA netif...");
             esp_netif_destroy(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
         }
+        _espNetif = nullptr;
 
         _isConnected = false;
         return true;
@@ -157,10 +202,145 @@ public:
         return _isConnected;
     }
 
+    /// @brief Link quality and retry counters
+    struct LinkStats
+    {
+        int8_t rssi{0};          ///< last sample (dBm)
+        int8_t rssiMin{0};       ///< since resetRssi()
+        int8_t rssiMax{0};       ///< since resetRssi()
+        int32_t rssiSum{0};      ///< since resetRssi()
+        uint32_t samples{0};     ///< since resetRssi()
+        uint8_t bssid[6]{};      ///< current AP
+        uint8_t channel{0};      ///< current AP
+        uint32_t attempts{0};    ///< connection attempts
+        uint32_t disconnects{0}; ///< link losses
+        uint32_t roams{0};       ///< AP changes requested by roam()
+    };
+
+    /// @brief Counters are updated from the event loop and the WiFi task, read as a copy
+    LinkStats stats() const { return _stats; }
+
+    void resetRssi()
+    {
+        _stats.rssiMin = _stats.rssiMax = _stats.rssi;
+        _stats.rssiSum = 0;
+        _stats.samples = 0;
+    }
+
+    /// @brief Modem sleep of the STA, applied now when connected, otherwise after GOT_IP.
+    /// The listen interval is a part of the association, it is used from the next connect.
+    void setPowerSave(wifi_ps_type_t ps, uint16_t listenInterval)
+    {
+        _ps = ps;
+        _listenInterval = listenInterval;
+        if (_gotIp)
+            applyPowerSave();
+    }
+
+    /// @brief Reads RSSI of the current AP
+    /// @return false - not associated
+    bool sampleRssi(int &rssi)
+    {
+        wifi_ap_record_t ap = {};
+        if (!_gotIp || esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+            return false;
+
+        rssi = ap.rssi;
+        if (_stats.samples == 0)
+            _stats.rssiMin = _stats.rssiMax = ap.rssi;
+        _stats.rssi = ap.rssi;
+        _stats.rssiMin = std::min(_stats.rssiMin, ap.rssi);
+        _stats.rssiMax = std::max(_stats.rssiMax, ap.rssi);
+        _stats.rssiSum += ap.rssi;
+        _stats.samples++;
+        memcpy(_stats.bssid, ap.bssid, sizeof(_stats.bssid));
+        _stats.channel = ap.primary;
+        return true;
+    }
+
+    /// @brief Scans for the configured SSID and moves to the strongest BSSID when it is
+    /// at least `hysteresisDb` better than the current AP. Blocks for the scan (~2 s).
+    /// @return true - roaming started, the link goes down and up again
+    bool roam(int hysteresisDb)
+    {
+        wifi_ap_record_t current = {};
+        wifi_config_t wifi_config = {};
+        if (!_gotIp || esp_wifi_sta_get_ap_info(&current) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+            return false;
+
+        wifi_scan_config_t scanConfig = {};
+        scanConfig.ssid = wifi_config.sta.ssid;
+        if (esp_wifi_scan_start(&scanConfig, true) != ESP_OK)
+            return false;
+
+        uint16_t count = maxRoamRecords;
+        wifi_ap_record_t records[maxRoamRecords];
+        if (esp_wifi_scan_get_ap_records(&count, records) != ESP_OK)
+            return false;
+
+        const wifi_ap_record_t *best = nullptr;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            if (memcmp(records[i].bssid, current.bssid, sizeof(current.bssid)) != 0 && (!best || records[i].rssi > best->rssi))
+                best = &records[i];
+        }
+
+        if (!best || best->rssi < current.rssi + hysteresisDb)
+        {
+            ESP_LOGI(TAG, "Roam check: current %d dBm, best other %d dBm, staying", current.rssi, best ? best->rssi : -127);
+            return false;
+        }
+
+        ESP_LOGW(TAG, "Roaming ch %u %d dBm -> " MACSTR " ch %u %d dBm", current.primary, current.rssi,
+                 MAC2STR(best->bssid), best->primary, best->rssi);
+        memcpy(wifi_config.sta.bssid, best->bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.channel = best->primary;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+            return false;
+
+        // the new AP is joined from onDisconnect, a failure falls back to the full scan
+        _roaming = true;
+        _directed = true;
+        _stats.roams++;
+        return esp_wifi_disconnect() == ESP_OK;
+    }
+
+    /// @brief Reconnect after roam() is in progress, the link loss is expected
+    bool roaming() const { return _roamConnect; }
+
     void onDisconnect()
     {
         _isConnected = false;
+        _roamConnect = false;
+        _stats.disconnects++;
         ESP_LOGI(TAG, "Wi-Fi disconnected");
+
+        if (_directed && !_gotIp)
+        {
+            // AP moved to another channel or is replaced, the next attempt scans all channels
+            ESP_LOGW(TAG, "Cached AP not reachable, full scan next time");
+            wifi_config_t wifi_config = {};
+            if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK)
+            {
+                wifi_config.sta.bssid_set = false;
+                wifi_config.sta.channel = 0;
+                wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+                esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            }
+            _directed = false;
+        }
+        _gotIp = false;
+
+        if (_roaming)
+        {
+            _roaming = false;
+            _connectStart = esp_timer_get_time();
+            _stats.attempts++;
+            _roamConnect = esp_wifi_connect() == ESP_OK;
+        }
+
         if (_disconnectedCallback)
         {
             _disconnectedCallback();
@@ -172,7 +352,15 @@ public:
         _isConnected = true;
         char ipStr[16];
         esp_ip4addr_ntoa(&event.ip_info.ip, ipStr, sizeof(ipStr));
-        ESP_LOGI(TAG, "Got IP: %s", ipStr);
+        ESP_LOGI(TAG, "Got IP: %s, %lld ms after connect (%s)", ipStr,
+                 (long long)(esp_timer_get_time() - _connectStart) / 1000, _directed ? "cached AP" : "full scan");
+        _gotIp = true;
+        _roamConnect = false;
+        saveCache();
+
+        // one-shot event, armed again after every connection
+        esp_wifi_set_rssi_threshold(literals::wifi_roam_rssi);
+        applyPowerSave();
 
         if (_connectedCallback)
         {
@@ -190,6 +378,11 @@ public:
         _disconnectedCallback = callback;
     }
 
+    void registerRssiLowCallback(WiFiRssiLowCallback callback)
+    {
+        _rssiLowCallback = callback;
+    }
+
     static void eventHandler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
     {
         WiFiClient *client = static_cast<WiFiClient *>(arg);
@@ -201,12 +394,75 @@ public:
         {
             client->onGotIP(*static_cast<ip_event_got_ip_t *>(event_data));
         }
+        else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW)
+        {
+            int rssi = static_cast<wifi_event_bss_rssi_low_t *>(event_data)->rssi;
+            ESP_LOGW(TAG, "RSSI low: %d dBm", rssi);
+            if (client->_rssiLowCallback)
+                client->_rssiLowCallback(rssi);
+        }
     }
 
 private:
     static constexpr const char *TAG = "STA";
+    static constexpr uint16_t maxRoamRecords = 8; ///< BSSIDs of one SSID considered by roam()
+
+    /// @brief BSSID and channel of the last AP for the SSID, NVS format "bssid(12 hex) channel ssid"
+    bool loadCache(const char *ssid, uint8_t (&bssid)[6], uint8_t &channel)
+    {
+        _cache = KeyVal::getInstance().readString(literals::kv_wifi_ap, "");
+        unsigned b[6], ch;
+        int pos = 0;
+        if (sscanf(_cache.c_str(), "%2x%2x%2x%2x%2x%2x %u %n", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &ch, &pos) != 7 ||
+            pos == 0 || _cache.compare(pos, std::string::npos, ssid) != 0 || ch == 0 || ch > 14)
+            return false;
+
+        for (int i = 0; i < 6; i++)
+            bssid[i] = static_cast<uint8_t>(b[i]);
+        channel = static_cast<uint8_t>(ch);
+        return true;
+    }
+
+    void applyPowerSave()
+    {
+        esp_err_t err = esp_wifi_set_ps(_ps);
+        if (err != ESP_OK)
+            ESP_LOGW(TAG, "esp_wifi_set_ps failed: %s", esp_err_to_name(err));
+        else
+            ESP_LOGI(TAG, "Power save %d, listen interval %u", static_cast<int>(_ps), _listenInterval);
+    }
+
+    void saveCache()
+    {
+        wifi_ap_record_t ap = {};
+        wifi_config_t wifi_config = {};
+        if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+            return;
+
+        char buf[80];
+        snprintf(buf, sizeof(buf), "%02x%02x%02x%02x%02x%02x %u %.32s", ap.bssid[0], ap.bssid[1], ap.bssid[2],
+                 ap.bssid[3], ap.bssid[4], ap.bssid[5], ap.primary, reinterpret_cast<const char *>(wifi_config.sta.ssid));
+        if (_cache != buf)
+        {
+            _cache = buf;
+            KeyVal::getInstance().writeString(literals::kv_wifi_ap, _cache);
+            ESP_LOGI(TAG, "AP cached [%s]", buf);
+        }
+    }
+
     bool _isConnected;                                ///< connection state
     esp_netif_t *_espNetif;                           ///<
+    bool _handlersRegistered{false};                  ///< event handlers are registered once
+    bool _directed{false};                            ///< association to the cached AP
+    bool _gotIp{false};                               ///< IP received since the last connect
+    int64_t _connectStart{0};                         ///< start of the connection attempt
+    std::string _cache;                               ///< cached AP as stored in NVS
+    bool _roaming{false};                             ///< disconnect requested by roam()
+    bool _roamConnect{false};                         ///< connecting to the roam target
+    LinkStats _stats{};                               ///< link quality and counters
+    wifi_ps_type_t _ps{WIFI_PS_MIN_MODEM};            ///< modem sleep, driver default
+    uint16_t _listenInterval{0};                      ///< in beacon intervals, 0 - driver default
     WiFiConnectedCallback _connectedCallback{};       ///< connect callback
     WiFiDisconnectedCallback _disconnectedCallback{}; ///< disconnect callback
+    WiFiRssiLowCallback _rssiLowCallback{};           ///< RSSI below literals::wifi_roam_rssi
 };
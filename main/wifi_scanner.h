@@ -8,17 +8,27 @@
 #pragma once
 
 #include <string.h>
+#include <array>
+#include <atomic>
+#include <algorithm>
 #include <functional>
+#include <mutex>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "literals.h"
 /*
 
     WiFiScanner wifiScanner;
-    wifiScanner.scan();
-    wifiScanner.printScanResults();
+    wifiScanner.init();
+    wifiScanner.scanAsync(literals::wifi_scan_dwell_ms, [] { ... });   // or scan() - blocks until done
+    wifiScanner.processResults(callback);
+    wifiScanner.down();
 
 */
 
@@ -29,12 +39,26 @@ struct APInfo
 };
 
 using ScanResultCallback = std::function<void(const APInfo &)>;
+using ScanDoneCallback = std::function<void()>;
 
+/// @brief WiFi scan driven by WIFI_EVENT_SCAN_DONE.
+/// Results are deduplicated by SSID (strongest BSSID wins), sorted by RSSI and kept
+/// with a timestamp in a fixed array, so they can be read again without a new scan.
 class WiFiScanner
 {
 public:
+    static constexpr size_t maxResults = 20; ///< SSIDs kept in the cache
+
     WiFiScanner()
     {
+        _done = xSemaphoreCreateBinary();
+    }
+
+    ~WiFiScanner()
+    {
+        unregisterHandler();
+        if (_done)
+            vSemaphoreDelete(_done);
     }
 
     /// @brief Initialize Wifi scanner
@@ -42,6 +66,18 @@ public:
     /// @return true if success
    void init(bool coreInit = false)
 {
+    // a running STA (WiFiClient) is shared, the scan runs next to its connection
+    wifi_mode_t mode;
+    _shared = !coreInit && is_wifi_sta_created() && esp_wifi_get_mode(&mode) == ESP_OK &&
+              (mode == WIFI_MODE_STA || mode == WIFI_MODE_APSTA);
+    if (_shared)
+    {
+        if (!_handler)
+            esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &WiFiScanner::eventHandler, this, &_handler);
+        ESP_LOGI("WiFi", "Scanning on the running STA");
+        return;
+    }
+
     if (coreInit)
     {
         // Initialize NVS
@@ -81,12 +117,14 @@ public:
         ESP_ERROR_CHECK(err);
     }
 
-    // Stop Wi-Fi if running and set mode
+    // Stop Wi-Fi if running and set mode, esp_wifi_stop returns after the driver is down
     esp_wifi_stop();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
 
+    if (!_handler)
+        esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &WiFiScanner::eventHandler, this, &_handler);
+
     ESP_LOGI("WiFi", "Wi-Fi initialized successfully in STA mode");
 }
 
@@ -101,6 +139,16 @@ public:
 
     void down()
     {
+        if (_pending)
+            esp_wifi_scan_stop();
+        _pending = false;
+        unregisterHandler();
+        if (_shared)
+        {
+            _shared = false;
+            return;
+        }
+
         esp_wifi_stop();
         esp_wifi_deinit();
         esp_wifi_set_mode(WIFI_MODE_NULL);
@@ -111,45 +159,162 @@ public:
         }
     }
 
-    void scan()
+    /// @brief Starts a scan, returns immediately
+    /// @param dwellMs active scan time per channel
+    /// @param done called from the event loop when the results are in the cache
+    /// @return false - the scan was not started
+    bool scanAsync(uint32_t dwellMs = literals::wifi_scan_dwell_ms, ScanDoneCallback done = {})
+    {
+        wifi_scan_config_t scan_config = {};
+        scan_config.show_hidden = false; // hidden SSIDs cannot be selected by name
+        scan_config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+        scan_config.scan_time.active.min = dwellMs / 2;
+        scan_config.scan_time.active.max = dwellMs;
+
+        _onDone = std::move(done);
+        xSemaphoreTake(_done, 0);
+        _pending = true;
+        _started = esp_timer_get_time();
+        esp_err_t err = esp_wifi_scan_start(&scan_config, false);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Scan start failed: %s", esp_err_to_name(err));
+            _pending = false;
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Scan blocking the caller until it is done
+    /// @return false - not started or timeout
+    bool scan(uint32_t dwellMs = literals::wifi_scan_dwell_ms)
+    {
+        if (!scanAsync(dwellMs))
+            return false;
+        if (xSemaphoreTake(_done, pdMS_TO_TICKS(literals::wifi_scan_timeout_ms)) == pdTRUE)
+            return true;
+
+        // no SCAN_DONE, the driver scan is stopped so the next one can start
+        ESP_LOGW(TAG, "Scan timeout");
+        _pending = false;
+        esp_wifi_scan_stop();
+        return false;
+    }
+
+    /// @brief Scan in progress
+    bool pending() const { return _pending; }
+
+    /// @brief Time of the cached results (esp_timer us), 0 - no scan yet
+    int64_t timestamp() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _timestamp;
+    }
+
+    /// @brief Cached results not older than maxAgeMs
+    bool fresh(uint32_t maxAgeMs) const
     {
-        wifi_scan_config_t scan_config = {
-            .ssid = nullptr,
-            .bssid = nullptr,
-            .channel = 0,
-            .show_hidden = true,
-            .scan_type = WIFI_SCAN_TYPE_ACTIVE,
-            .scan_time{{100, 500}, 500}};
-        ESP_ERROR_CHECK(esp_wifi_scan_start(&scan_config, true)); // true for block scan
+        int64_t ts = timestamp();
+        return ts && esp_timer_get_time() - ts < maxAgeMs * 1000LL;
     }
 
     void debugScanResults()
     {
-        uint16_t number = 20;
-        wifi_ap_record_t ap_records[number];
-        ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_records));
-        for (int i = 0; i < number; i++)
+        processResults([](const APInfo &info)
+                       { printf("SSID: %s, RSSI: %d\n", info.ap_name, info.rssi); });
+    }
+
+    /// @brief Passes the cached results, strongest first
+    void processResults(ScanResultCallback callback)
+    {
+        std::array<APInfo, maxResults> results;
+        size_t count;
         {
-            printf("SSID: %s, RSSI: %d\n", ap_records[i].ssid, ap_records[i].rssi);
+            std::lock_guard<std::mutex> lock(_mutex);
+            results = _results;
+            count = _count;
         }
+
+        for (size_t i = 0; i < count; i++)
+            callback(results[i]);
     }
 
-    void processResults(ScanResultCallback callback)
+private:
+    static constexpr const char *TAG = "Scanner";
+    static constexpr uint16_t maxRecords = 32; ///< BSSIDs read from the driver
+
+    static void eventHandler(void *arg, esp_event_base_t, int32_t, void *)
+    {
+        // the roam scan of WiFiClient also ends with SCAN_DONE
+        auto *self = static_cast<WiFiScanner *>(arg);
+        if (self->_pending)
+            self->collect();
+    }
+
+    /// @brief Reads the driver list into the cache, runs in the event loop
+    void collect()
     {
-        uint16_t number = 20;
-        wifi_ap_record_t ap_records[number];
-        ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_records));
+        uint16_t number = maxRecords;
+        bool ok = esp_wifi_scan_get_ap_records(&number, _records.data()) == ESP_OK;
+        if (ok)
+            store(number);
+
+        ESP_LOGI(TAG, "Scan %s in %lld ms, %u BSSIDs", ok ? "done" : "failed",
+                 (long long)(esp_timer_get_time() - _started) / 1000, ok ? number : 0u);
+        _pending = false;
+        xSemaphoreGive(_done);
+        if (_onDone)
+            _onDone();
+    }
 
-        for (int i = 0; i < number; i++)
+    /// @brief Driver records into the cache, a failed read keeps the previous results and their timestamp
+    void store(uint16_t number)
+    {
+        // strongest first, then the first occurrence of each SSID is kept
+        std::sort(_records.begin(), _records.begin() + number, [](const wifi_ap_record_t &a, const wifi_ap_record_t &b)
+                  { return a.rssi > b.rssi; });
         {
-            APInfo info;
-            strncpy(info.ap_name, (const char *)ap_records[i].ssid, sizeof(info.ap_name) - 1);
-            info.ap_name[sizeof(info.ap_name) - 1] = '\0';
-            info.rssi = ap_records[i].rssi;
-            callback(info);
+            std::lock_guard<std::mutex> lock(_mutex);
+            _count = 0;
+            for (uint16_t i = 0; i < number && _count < maxResults; i++)
+            {
+                const char *ssid = reinterpret_cast<const char *>(_records[i].ssid);
+                if (!ssid[0])
+                    continue;
+                bool seen = std::any_of(_results.begin(), _results.begin() + _count, [ssid](const APInfo &r)
+                                        { return strncmp(r.ap_name, ssid, sizeof(r.ap_name)) == 0; });
+                if (seen)
+                    continue;
+
+                APInfo &info = _results[_count++];
+                strncpy(info.ap_name, ssid, sizeof(info.ap_name) - 1);
+                info.ap_name[sizeof(info.ap_name) - 1] = '\0';
+                info.rssi = _records[i].rssi;
+            }
+            _timestamp = esp_timer_get_time();
+        }
+    }
+
+    void unregisterHandler()
+    {
+        if (_handler)
+        {
+            esp_event_handler_instance_unregister(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, _handler);
+            _handler = nullptr;
         }
     }
 
-private:
     esp_netif_t *_cl{nullptr};
+    bool _shared{false};                     ///< driver owned by WiFiClient
+    esp_event_handler_instance_t _handler{nullptr};
+    SemaphoreHandle_t _done{nullptr};        ///< given on SCAN_DONE, for scan()
+    ScanDoneCallback _onDone{};
+    std::atomic<bool> _pending{false};       ///< scan started by this instance
+    int64_t _started{0};
+
+    std::array<wifi_ap_record_t, maxRecords> _records{}; ///< driver records, used only in collect()
+    mutable std::mutex _mutex;                           ///< cache
+    std::array<APInfo, maxResults> _results{};
+    size_t _count{0};
+    int64_t _timestamp{0};
 };
@@ -15,14 +15,15 @@
 #include <iomanip>
 
 #include "wifi_task.h"
-#include "key_val.h"
+#include "config.h"
 #include "literals.h"
 #include "application.h"
+#include "esp_timer.h"
 
 
 WifiTask::WifiTask()
 {
-	_queue = xQueueCreate(2, sizeof(int));
+	_queue = xQueueCreate(4, sizeof(int));
 }
 
 WifiTask::~WifiTask()
@@ -53,8 +54,7 @@ void WifiTask::loop()
 		.ip = {.addr = 0},
 		.netmask = {.addr = 0},
 		.gw = {.addr = 0}};
-	bool processit = true;
-	int receivedMode = static_cast<int>(Mode::Stop);
+	int received = static_cast<int>(Mode::Stop);
 
 	//wifi connection lambdas --->
 	WiFiConnectedCallback ConnCallback = [this](const ip_event_got_ip_t &event)
@@ -84,6 +84,7 @@ void WifiTask::loop()
 
 		if (_connectionManager)
 			_connectionManager->setConnected();
+		notify(evLinkUp);
 	};
 
 	WiFiDisconnectedCallback DiscCallback = [this]()
@@ -92,6 +93,12 @@ void WifiTask::loop()
 		Application::getInstance()->getDisplayTask()->settingMsg("Disconnected");
 		if (_connectionManager)
 			_connectionManager->setDisconnected();
+		notify(evLinkLost);
+	};
+
+	WiFiRssiLowCallback RssiLowCallback = [this](int)
+	{
+		notify(evRssiLow);
 	};
 
 	WiFiApConnectedCallback APConnCallback =  [this](uint8_t* mac, uint8_t aid) {
@@ -108,41 +115,177 @@ void WifiTask::loop()
 
 	wfcli.registerDisconnectedCallback(DiscCallback);
 	wfcli.registerConnectedCallback(ConnCallback);
+	wfcli.registerRssiLowCallback(RssiLowCallback);
 	wftt.registerClientConnectedCallback(APConnCallback);
 	wftt.registerClientDisconnectedCallback(APDiscCallback);
 	
 	// <------
 
+	// new SSID or IP setup - reconnect the STA only, other tasks keep running
+	// (during the setup AP the STA is reconnected when the AP is closed)
+	ConfigStore::getInstance().subscribe(Config::Wifi | Config::Network, [this](const Config &, uint32_t)
+										 {
+		if (_mode == Mode::Client)
+			switchMode(Mode::Client);
+		else
+			_staDirty = true; });
+
+	// modem sleep is changed on the running link
+	ConfigStore::getInstance().subscribe(Config::Power, [this](const Config &, uint32_t)
+										 { notify(evPower); });
+
 	Application::getInstance()->signalTaskStart(Application::TaskBit::WiFi);
 
+	processMessage(Mode::Stop, wftt, wfcli, staticip);
+
+	int64_t reconnectAt = 0;	// pending STA reconnect, 0 - none
+	int64_t lostAt = 0;			// link loss, for time-to-IP
+	int64_t sampleAt = esp_timer_get_time();	// next RSSI sample
+	int64_t reportAt = esp_timer_get_time() + literals::wifi_stats_interval_ms * 1000LL;
+	int64_t roamCheckAt = 0;	// last roam check, for the hold time
 	while (true)
-	{ // Loop forever
+	{ // Loop forever, driven by mode requests, link events and the RSSI sampling
+
+		bool linkUp = _mode == Mode::Client && _connectionManager && _connectionManager->isConnected();
+		int64_t deadline = reconnectAt;
+		if (linkUp && (!deadline || sampleAt < deadline))
+			deadline = sampleAt;
+
+		TickType_t wait = portMAX_DELAY;
+		if (deadline)
+		{
+			int64_t left = deadline - esp_timer_get_time();
+			wait = left > 0 ? pdMS_TO_TICKS(left / 1000 + 1) : 0;
+		}
+		if (uxQueueMessagesWaiting(_queue))
+			wait = 0; // requested before the task started
+
+		uint32_t events = 0;
+		xTaskNotifyWait(0, UINT32_MAX, &events, wait);
 
-		auto res = xQueueReceive(_queue, (void *)&receivedMode, 0);
-		if (res == pdTRUE)
+		// mode requests in the order of arrival
+		while (xQueueReceive(_queue, (void *)&received, 0) == pdTRUE)
+		{
+			// new mode replaces a pending reconnect
+			reconnectAt = 0;
+			lostAt = 0;
+			_backoff.reset();
+			processMessage(static_cast<Mode>(received), wftt, wfcli, staticip);
+		}
+
+		if (events & evScanDone)
+		{
+			// scan for the AP setup finished, the radio can switch to AP
+			if (_mode == Mode::AP && _scanning)
+			{
+				_scanning = false;
+				_scanner.down();
+				startAccessPoint(wftt);
+			}
+		}
+		if (events & evPower)
+		{
+			const auto &profile = PowerProfile::get(ConfigStore::getInstance().get().power);
+			ESP_LOGI(TAG, "Power profile %s", profile.name);
+			wfcli.setPowerSave(profile.wifiPs, profile.listenInterval);
+		}
+		if (events & evRssiLow)
 		{
-			processit = true;
+			if (_mode == Mode::Client)
+				roamCheck(wfcli, roamCheckAt);
+		}
+		if (events & evLinkLost)
+		{
+			// the roam target is joined by the client itself
+			if (staActive() && !reconnectAt && !wfcli.roaming())
+			{
+				if (!lostAt)
+					lostAt = esp_timer_get_time();
+				uint32_t delay = _backoff.next();
+				ESP_LOGI(TAG, "Link lost, reconnect in %lu ms", (unsigned long)delay);
+				reconnectAt = esp_timer_get_time() + delay * 1000LL;
+			}
+		}
+		// link lost and up again since the last wake, the current state decides
+		if ((events & evLinkUp) && _connectionManager && _connectionManager->isConnected())
+		{
+			if (_clientStart)
+			{
+				ESP_LOGI(TAG, "IP address %lld ms after client mode start", (long long)(esp_timer_get_time() - _clientStart) / 1000);
+				_clientStart = 0;
+			}
+			if (lostAt)
+				ESP_LOGI(TAG, "IP address %lld ms after link loss, %lu attempts", (long long)(esp_timer_get_time() - lostAt) / 1000, (unsigned long)_backoff.step());
+			_backoff.reset();
+			reconnectAt = 0;
+			lostAt = 0;
+			sampleAt = esp_timer_get_time();
 		}
 
-		if (processit) {
-			processMessage(static_cast<Mode>(receivedMode), wftt, wfcli, staticip);
-			processit = false;
+		int64_t now = esp_timer_get_time();
+		if (reconnectAt && now >= reconnectAt)
+		{
+			// backoff elapsed
+			reconnectAt = 0;
+			if (staActive())
+			{
+				ESP_LOGI(TAG, "Reconnecting (attempt %lu, %lu in the last hour)",
+						 (unsigned long)_backoff.step(), (unsigned long)_backoff.attemptsLastHour());
+				wfcli.reconnect();
+			}
 		}
-		
 
-		vTaskDelay(500 / portTICK_PERIOD_MS);
+		linkUp = _mode == Mode::Client && _connectionManager && _connectionManager->isConnected();
+		if (linkUp && now >= sampleAt)
+		{
+			sampleAt = now + literals::wifi_rssi_interval_ms * 1000LL;
+			int rssi = 0;
+			if (wfcli.sampleRssi(rssi) && rssi < literals::wifi_roam_rssi)
+				roamCheck(wfcli, roamCheckAt);
+
+			if (now >= reportAt)
+			{
+				reportAt = now + literals::wifi_stats_interval_ms * 1000LL;
+				reportStats(wfcli.stats());
+				wfcli.resetRssi();
+			}
+		}
 	}
 }
 
 
 void WifiTask::processMessage(const Mode& mode, WiFiAccessPoint& wftt,	WiFiClient& wfcli, esp_netif_ip_info_t &staticip)
 {
+			_mode = mode;
+
+			// a new mode cancels the scan for the AP setup
+			if (_scanning)
+			{
+				_scanning = false;
+				_scanner.down();
+			}
+
+			// setup AP running next to the STA, closing it keeps the STA unless its setting changed
+			if (_apConcurrent && mode != Mode::AP)
+			{
+				// the AP may not be started yet (scan), then the STA only stays
+				if (_connectionManager && _connectionManager->isAPActive())
+					stopAccessPoint(wftt);
+				_apConcurrent = false;
+				if (mode == Mode::Client && !_staDirty.exchange(false) && _connectionManager && _connectionManager->isConnected())
+				{
+					ESP_LOGI(TAG, "Setup AP closed, STA kept");
+					Application::getInstance()->getWebTask()->command(WebTask::Mode::Client);
+					return;
+				}
+			}
+
 			// Stop mode & check initial configuration
 			if (mode == Mode::Stop)
 			{
 				ESP_LOGI(TAG, "All STOP");
 				// stop all previous wifi modes
-				wftt.stop();
+				stopAccessPoint(wftt);
 				if (wfcli.isConnected())
 				{
 					wfcli.disconnect();
@@ -154,7 +297,9 @@ void WifiTask::processMessage(const Mode& mode, WiFiAccessPoint& wftt,	WiFiClien
 			else if (mode == Mode::Client)
 			{
 				ESP_LOGI(TAG, "CLIENT MODE");
-				wftt.stop();
+				_clientStart = esp_timer_get_time();
+				_staDirty = false;
+				stopAccessPoint(wftt);
 				if (wfcli.isConnected())
 				{
 					wfcli.disconnect();
@@ -162,72 +307,153 @@ void WifiTask::processMessage(const Mode& mode, WiFiAccessPoint& wftt,	WiFiClien
 
 				wfcli.init(false);
 
-				KeyVal &kv = KeyVal::getInstance();
-				esp_netif_str_to_ip4(kv.readString(literals::kv_ip).c_str(), &staticip.ip);
-				esp_netif_str_to_ip4(kv.readString(literals::kv_mask).c_str(), &staticip.netmask);
-				esp_netif_str_to_ip4(kv.readString(literals::kv_gtw).c_str(), &staticip.gw);
+				const Config cfg = ConfigStore::getInstance().get();
+				const auto &profile = PowerProfile::get(cfg.power);
+				wfcli.setPowerSave(profile.wifiPs, profile.listenInterval);
+
+				staticip = {};
+				esp_netif_str_to_ip4(cfg.ip.c_str(), &staticip.ip);
+				esp_netif_str_to_ip4(cfg.mask.c_str(), &staticip.netmask);
+				esp_netif_str_to_ip4(cfg.gw.c_str(), &staticip.gw);
 
 				bool cntok = false;
 				if (staticip.ip.addr == 0 || staticip.netmask.addr == 0)
 				{
 					// DHCP mode
-					cntok = wfcli.connect(kv.readString(literals::kv_ssid), kv.readString(literals::kv_passwd), true, nullptr);
+					cntok = wfcli.connect(cfg.ssid, cfg.passwd, true, nullptr);
 				}
 				else
 				{
 					// static IP mode
-					cntok = wfcli.connect(kv.readString(literals::kv_ssid), kv.readString(literals::kv_passwd), false, &staticip);
+					cntok = wfcli.connect(cfg.ssid, cfg.passwd, false, &staticip);
 				}
 
-				// no nedded web interface
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::Stop);
+				// setting interface is not needed, only data endpoints
+				Application::getInstance()->getWebTask()->command(WebTask::Mode::Client);
 			}
 			else if (mode == Mode::AP)
 			{
 				ESP_LOGI(TAG, "AP MODE");
-				if (wfcli.isConnected())
+
+				// previous AP instance must be down
+				if (_connectionManager && _connectionManager->isAPActive())
+					stopAccessPoint(wftt);
+
+				// with a working STA link the AP runs next to it (APSTA), MQTT data keep coming
+				_apConcurrent = wfcli.isConnected() && _connectionManager && _connectionManager->isConnected();
+				if (!_apConcurrent && wfcli.isConnected())
 				{
 					wfcli.disconnect();
 				}
-			
-				if (_connectionManager) {
-				 while(	_connectionManager->isAPActive()) {
-					vTaskDelay(500 / portTICK_PERIOD_MS);
-				 }
+
+				// scan APs for info, recent results are reused
+				if (_scanner.fresh(literals::wifi_scan_cache_ms))
+				{
+					startAccessPoint(wftt);
+					return;
 				}
 
-				// scan APs for info
-				
 				_scanner.init(false);
-				_scanner.scan();
-
-				// clear web task AP info
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::ClearAPInfo);
-				ScanResultCallback callback = [](const APInfo &info)
+				_scanning = _scanner.scanAsync(literals::wifi_scan_dwell_ms, [this]()
+											   {
+					notify(evScanDone); });
+				if (!_scanning)
 				{
-					// send each AP into WebTask
-					Application::getInstance()->getWebTask()->apInfo(info);
-				};
-				_scanner.processResults(callback);
-				_scanner.down();
-				// AP start
-				std::string a = "AP started: ";
-				a += literals::ap_name;
-
-				Application::getInstance()->getDisplayTask()->settingMsg(a);
-				wftt.start(literals::ap_name, literals::ap_passwd);
-				Application::getInstance()->getWebTask()->command(WebTask::Mode::Setting);
-				
+					_scanner.down();
+					startAccessPoint(wftt);
+				}
 			}
 		}
 
+void WifiTask::startAccessPoint(WiFiAccessPoint &wftt)
+{
+	// clear web task AP info
+	Application::getInstance()->getWebTask()->command(WebTask::Mode::ClearAPInfo);
+	ScanResultCallback callback = [](const APInfo &info)
+	{
+		// send each AP into WebTask
+		Application::getInstance()->getWebTask()->apInfo(info);
+	};
+	_scanner.processResults(callback);
+
+	// AP start
+	std::string a = "AP started: ";
+	a += literals::ap_name;
+
+	Application::getInstance()->getDisplayTask()->settingMsg(a);
+	wftt.start(literals::ap_name, literals::ap_passwd, _apConcurrent);
+	if (_connectionManager)
+		_connectionManager->setAPActive();
+	Application::getInstance()->getWebTask()->command(WebTask::Mode::Setting);
+}
+
+void WifiTask::stopAccessPoint(WiFiAccessPoint &wftt)
+{
+	wftt.stop();
+	_apConcurrent = false;
+	if (_connectionManager)
+		_connectionManager->setAPDeactive();
+}
+
+void WifiTask::roamCheck(WiFiClient &wfcli, int64_t &lastCheck)
+{
+	// hold time - a weak link must not cause a scan every few seconds
+	int64_t now = esp_timer_get_time();
+	if (lastCheck && now - lastCheck < literals::wifi_roam_hold_ms * 1000LL)
+		return;
+
+	lastCheck = now;
+	wfcli.roam(literals::wifi_roam_hysteresis_db);
+}
+
+void WifiTask::reportStats(const WiFiClient::LinkStats &st)
+{
+	{
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		_linkStats = st;
+	}
+
+	int avg = st.samples ? static_cast<int>(st.rssiSum / static_cast<int32_t>(st.samples)) : st.rssi;
+	ESP_LOGI(TAG, "RSSI %d dBm (min %d, avg %d, max %d), ch %u, attempts %lu, disconnects %lu, roams %lu",
+			 st.rssi, st.rssiMin, avg, st.rssiMax, st.channel,
+			 (unsigned long)st.attempts, (unsigned long)st.disconnects, (unsigned long)st.roams);
+
+	// exported next to the display metrics
+	const Config cfg = ConfigStore::getInstance().get();
+	if (cfg.pubTopic.empty() || cfg.pubIntervalSec == 0)
+		return;
+
+	char json[256];
+	snprintf(json, sizeof(json),
+			 "{\"rssi\":%d,\"rssiMin\":%d,\"rssiAvg\":%d,\"rssiMax\":%d,\"bssid\":\"" MACSTR "\",\"channel\":%u,"
+			 "\"attempts\":%lu,\"disconnects\":%lu,\"roams\":%lu}",
+			 st.rssi, st.rssiMin, avg, st.rssiMax, MAC2STR(st.bssid), st.channel,
+			 (unsigned long)st.attempts, (unsigned long)st.disconnects, (unsigned long)st.roams);
+	Application::getInstance()->getMqttTask()->publish(cfg.pubTopic + "/wifi", json, 0, false);
+}
+
+WiFiClient::LinkStats WifiTask::linkStats() const
+{
+	std::lock_guard<std::mutex> lock(_statsMutex);
+	return _linkStats;
+}
+
 void WifiTask::switchMode(Mode mode)
 {
-	if (_queue)
+	int modeToSend = static_cast<int>(mode);
+	if (!_queue || xQueueSendToBack(_queue, (void *)&modeToSend, pdMS_TO_TICKS(100)) != pdTRUE)
 	{
-		int modeToSend = static_cast<int>(mode);
-		xQueueSendToBack(_queue, (void *)&modeToSend, 0);
+		ESP_LOGE(TAG, "Mode request %d dropped", modeToSend);
+		return;
 	}
+	notify(evMode);
+}
+
+void WifiTask::notify(uint32_t events)
+{
+	// not started yet - link events are not registered, the queued mode is picked up at start
+	if (task())
+		xTaskNotify(task(), events, eSetBits);
 }
 
 bool WifiTask::init(std::shared_ptr<ConnectionManager> connMgr, const char *name, UBaseType_t priority, const configSTACK_DEPTH_TYPE stackDepth)
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include "hardware.h"
 #include "rptask.h"
 #include "access_point.h"
@@ -14,6 +16,7 @@
 #include "literals.h"
 #include "connection_manager.h"
 #include "wifi_scanner.h"
+#include "backoff.h"
 
 
 class WifiTask : public RPTask
@@ -28,6 +31,11 @@ public:
 	WifiTask();
 	virtual ~WifiTask();
 	void switchMode(Mode mode);
+	Mode mode() const { return _mode; }
+	/// @brief Setup AP runs next to the connected STA (APSTA)
+	bool apConcurrent() const { return _apConcurrent; }
+	/// @brief Link statistics of the last report
+	WiFiClient::LinkStats linkStats() const;
 	bool init(std::shared_ptr<ConnectionManager> connMgr, const char * name, UBaseType_t priority = tskIDLE_PRIORITY, const configSTACK_DEPTH_TYPE stackDepth = configMINIMAL_STACK_SIZE);
 
 protected:
@@ -36,11 +44,35 @@ protected:
 private:
 	void processMessage(const Mode& mode, WiFiAccessPoint& wftt, WiFiClient& wfcli, esp_netif_ip_info_t &staticip);
 	std::string createClientConnectedMessage(bool connect, uint8_t aid, const uint8_t mac[6]) ;
+	void startAccessPoint(WiFiAccessPoint &wftt);
+	void stopAccessPoint(WiFiAccessPoint &wftt);
+	/// @brief STA link is maintained - client mode or the setup AP next to it
+	bool staActive() const { return _mode == Mode::Client || _apConcurrent; }
+	void roamCheck(WiFiClient &wfcli, int64_t &lastCheck);
+	void reportStats(const WiFiClient::LinkStats &st);
+
+	/// @brief Posts events as task notification bits, a pending bit cannot overflow
+	void notify(uint32_t events);
+
+	// link events posted by the WiFi callbacks, mode requests go through the queue
+	static constexpr uint32_t evLinkLost = 1 << 0;
+	static constexpr uint32_t evLinkUp = 1 << 1;
+	static constexpr uint32_t evRssiLow = 1 << 2;
+	static constexpr uint32_t evScanDone = 1 << 3;
+	static constexpr uint32_t evPower = 1 << 4;
+	static constexpr uint32_t evMode = 1 << 5;	///< mode request queued
 
 private:
 	WiFiScanner 	_scanner;
-	Mode            _mode {Mode::Stop};
+	bool			_scanning{false};	///< scan for the AP setup in progress
+	std::atomic<bool> _apConcurrent{false};	///< setup AP next to the STA
+	std::atomic<bool> _staDirty{false};	///< STA setting changed while the setup AP runs
+	std::atomic<Mode> _mode {Mode::Stop};
 	QueueHandle_t 	_queue;
+	Backoff			_backoff{literals::wifi_backoff_base_ms, literals::wifi_backoff_cap_ms};
+	int64_t			_clientStart{0};	///< Mode::Client requested, for time-to-IP
+	mutable std::mutex _statsMutex;
+	WiFiClient::LinkStats _linkStats{};
 	std::shared_ptr<ConnectionManager> _connectionManager;
 	static constexpr const char *TAG = "WifiTask";
 };
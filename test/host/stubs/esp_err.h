@@ -0,0 +1,16 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   esp_err.h  Host stub
+/// @author Petr Vanek
+
+#pragma once
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_FOUND 0x105
+
+inline const char *esp_err_to_name(esp_err_t err) { return err == ESP_OK ? "ESP_OK" : "ESP_FAIL"; }
@@ -0,0 +1,19 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   esp_heap_caps.h  Host stub
+/// @author Petr Vanek
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline void *heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline void heap_caps_free(void *ptr) { free(ptr); }
+inline size_t esp_get_free_heap_size() { return 0; }
+inline size_t esp_get_minimum_free_heap_size() { return 0; }
@@ -0,0 +1,75 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   esp_http_server.h  Host stub, the response goes to a test sink
+/// @author Petr Vanek
+
+#pragma once
+
+#include <string.h>
+#include <sys/types.h>
+#include <functional>
+#include "esp_err.h"
+
+typedef enum
+{
+    HTTPD_400_BAD_REQUEST,
+    HTTPD_404_NOT_FOUND,
+    HTTPD_500_INTERNAL_SERVER_ERROR
+} httpd_err_code_t;
+
+/// @brief Request of the test, chunks are passed to `sink`
+typedef struct httpd_req
+{
+    const char *query{nullptr};
+    std::function<bool(const char *data, size_t len)> sink;
+    int error{-1};
+    bool finished{false};
+} httpd_req_t;
+
+inline esp_err_t httpd_resp_set_type(httpd_req_t *, const char *) { return ESP_OK; }
+inline esp_err_t httpd_resp_set_hdr(httpd_req_t *, const char *, const char *) { return ESP_OK; }
+
+inline esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *)
+{
+    req->error = error;
+    return ESP_OK;
+}
+
+inline esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t len)
+{
+    if (!buf || len == 0)
+    {
+        req->finished = true;
+        return ESP_OK;
+    }
+    return req->sink(buf, static_cast<size_t>(len)) ? ESP_OK : ESP_FAIL;
+}
+
+inline esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t len)
+{
+    if (!req->query || strlen(req->query) >= len)
+        return ESP_ERR_NOT_FOUND;
+    strcpy(buf, req->query);
+    return ESP_OK;
+}
+
+inline esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len)
+{
+    size_t keyLen = strlen(key);
+    for (const char *p = qry; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : nullptr)
+    {
+        if (strncmp(p, key, keyLen) == 0 && p[keyLen] == '=')
+        {
+            const char *v = p + keyLen + 1;
+            size_t n = strcspn(v, "&");
+            if (n >= len)
+                return ESP_FAIL;
+            memcpy(val, v, n);
+            val[n] = '\0';
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
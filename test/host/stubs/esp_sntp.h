@@ -0,0 +1,8 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   esp_sntp.h  Host stub
+/// @author Petr Vanek
+
+#pragma once
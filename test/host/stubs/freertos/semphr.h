@@ -0,0 +1,38 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   semphr.h  Host stub, mutex semaphores only (one tick = 1 ms)
+/// @author Petr Vanek
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include "FreeRTOS.h"
+
+struct HostSemaphore
+{
+    std::timed_mutex mutex;
+};
+
+typedef HostSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new HostSemaphore(); }
+inline void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    if (wait == portMAX_DELAY)
+    {
+        sem->mutex.lock();
+        return pdTRUE;
+    }
+    return sem->mutex.try_lock_for(std::chrono::milliseconds(wait)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem->mutex.unlock();
+    return pdTRUE;
+}
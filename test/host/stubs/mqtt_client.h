@@ -0,0 +1,138 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   mqtt_client.h  Host stub of esp-mqtt
+/// @author Petr Vanek
+///
+/// Models the locking of esp-mqtt: every API call takes the client API lock (recursive
+/// mutex) and the event task holds it while the event handler runs.
+/// esp_mqtt_client_dispatch() plays the event task.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "esp_err.h"
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+
+typedef enum
+{
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+} esp_mqtt_event_id_t;
+
+struct esp_mqtt_client
+{
+    std::recursive_mutex apiLock;
+    esp_event_handler_t handler{nullptr};
+    void *handlerArgs{nullptr};
+    int msgId{0};
+    std::atomic<int> subscribes{0};
+    std::atomic<int> unsubscribes{0};
+};
+
+typedef esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef struct
+{
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char *topic;
+    int topic_len;
+    int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct
+{
+    struct
+    {
+        struct
+        {
+            const char *uri;
+        } address;
+    } broker;
+    struct
+    {
+        const char *username;
+        struct
+        {
+            const char *password;
+        } authentication;
+    } credentials;
+    struct
+    {
+        bool disable_auto_reconnect;
+    } network;
+    struct
+    {
+        int keepalive;
+    } session;
+} esp_mqtt_client_config_t;
+
+/// @brief Test hook - the client created last
+inline esp_mqtt_client_handle_t hostMqttClient = nullptr;
+
+inline esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *) { return hostMqttClient = new esp_mqtt_client(); }
+
+inline esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t, esp_event_handler_t handler, void *args)
+{
+    std::lock_guard<std::recursive_mutex> lock(client->apiLock);
+    client->handler = handler;
+    client->handlerArgs = args;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t) { return ESP_OK; }
+inline esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t) { return ESP_OK; }
+inline esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    delete client;
+    return ESP_OK;
+}
+inline esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t) { return ESP_OK; }
+inline esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t) { return ESP_OK; }
+
+inline int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *, int)
+{
+    std::lock_guard<std::recursive_mutex> lock(client->apiLock);
+    client->subscribes++;
+    return ++client->msgId;
+}
+
+inline int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *)
+{
+    std::lock_guard<std::recursive_mutex> lock(client->apiLock);
+    client->unsubscribes++;
+    return ++client->msgId;
+}
+
+inline int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *, const char *, int, int, int)
+{
+    std::lock_guard<std::recursive_mutex> lock(client->apiLock);
+    return ++client->msgId;
+}
+
+/// @brief Test hook - delivers one event like the esp-mqtt task
+inline void esp_mqtt_client_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_t &event)
+{
+    std::lock_guard<std::recursive_mutex> lock(client->apiLock);
+    event.client = client;
+    if (client->handler)
+        client->handler(client->handlerArgs, "MQTT_EVENTS", event.event_id, &event);
+}
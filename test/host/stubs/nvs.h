@@ -0,0 +1,97 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   nvs.h  Host stub, one in-memory namespace with call counters
+/// @author Petr Vanek
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <variant>
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_NO_FREE_PAGES 0x110d
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+#define ESP_ERR_NVS_TYPE_MISMATCH 0x1104
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+/// @brief Test hook - stored values, calls and injected failures
+struct HostNvs
+{
+    std::map<std::string, std::variant<std::string, uint32_t>> values;
+    int sets{0};
+    int commits{0};
+    esp_err_t setError{ESP_OK};    ///< returned by nvs_set_* when failSetAt is reached
+    int failSetAt{-1};             ///< index of the failing set, -1 - none
+    esp_err_t commitError{ESP_OK}; ///< returned by nvs_commit
+};
+
+inline HostNvs hostNvs;
+
+inline esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *handle)
+{
+    *handle = 1;
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t) {}
+
+inline esp_err_t hostNvsSet(const char *key, std::variant<std::string, uint32_t> value)
+{
+    if (hostNvs.sets++ == hostNvs.failSetAt)
+        return hostNvs.setError;
+    hostNvs.values[key] = std::move(value);
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_set_u32(nvs_handle_t, const char *key, uint32_t value) { return hostNvsSet(key, value); }
+inline esp_err_t nvs_set_str(nvs_handle_t, const char *key, const char *value) { return hostNvsSet(key, std::string(value)); }
+
+inline esp_err_t nvs_get_u32(nvs_handle_t, const char *key, uint32_t *out)
+{
+    auto it = hostNvs.values.find(key);
+    if (it == hostNvs.values.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    const auto *v = std::get_if<uint32_t>(&it->second);
+    if (!v)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    *out = *v;
+    return ESP_OK;
+}
+
+/// @brief out nullptr - length of the string including the terminating NUL
+inline esp_err_t nvs_get_str(nvs_handle_t, const char *key, char *out, size_t *length)
+{
+    auto it = hostNvs.values.find(key);
+    if (it == hostNvs.values.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    const auto *v = std::get_if<std::string>(&it->second);
+    if (!v)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    if (out)
+    {
+        if (*length < v->size() + 1)
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out, v->c_str(), v->size() + 1);
+    }
+    *length = v->size() + 1;
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_commit(nvs_handle_t)
+{
+    hostNvs.commits++;
+    return hostNvs.commitError;
+}
@@ -0,0 +1,12 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   nvs_flash.h  Host stub
+/// @author Petr Vanek
+
+#pragma once
+
+#include "nvs.h"
+
+inline esp_err_t nvs_flash_init() { return ESP_OK; }
@@ -0,0 +1,188 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_form_parser.cpp
+/// @author Petr Vanek
+///
+/// FormParser fed the way the POST handler does it - Content-Length check, then
+/// chunks of FormParser::recvChunk bytes - and with random chunk splits. The parsed
+/// pairs and the rejections must not depend on where the body is split.
+
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "form_parser.h"
+#include "test_util.h"
+
+namespace
+{
+    using Pairs = std::vector<std::pair<std::string, std::string>>;
+
+    struct Result
+    {
+        Pairs pairs;
+        int errors{0};
+        bool accepted{false};
+
+        bool operator==(const Result &o) const { return pairs == o.pairs && errors == o.errors && accepted == o.accepted; }
+    };
+
+    /// @brief The receive loop of the POST handler, chunk sizes from next()
+    template <typename Next>
+    Result parse(const std::string &body, Next &&next)
+    {
+        Result r;
+        if (!FormParser::isValidLength(body.size()))
+            return r;
+
+        r.accepted = true;
+        FormParser parser([&r](std::string_view key, std::string_view value)
+                          { r.pairs.emplace_back(key, value); });
+        size_t pos = 0;
+        while (pos < body.size())
+        {
+            size_t n = std::min(body.size() - pos, next());
+            parser.feed(body.data() + pos, n);
+            pos += n;
+        }
+        parser.finish();
+        r.errors = parser.errors();
+        CHECK(parser.pairs() == static_cast<int>(r.pairs.size()));
+        return r;
+    }
+
+    Result recv(const std::string &body)
+    {
+        return parse(body, []
+                     { return FormParser::recvChunk; });
+    }
+
+    struct Case
+    {
+        std::string body;
+        Pairs pairs;
+        int errors;
+    };
+}
+
+int main()
+{
+    const std::string key24(FormParser::maxKey, 'k');
+    const std::string key25(FormParser::maxKey + 1, 'k');
+    const std::string value256(FormParser::maxValue, 'v');
+    const std::string value257(FormParser::maxValue + 1, 'v');
+
+    // a password of 64 characters that all need an escape - 192 B encoded
+    const char *escapes[] = {"%26", "%3D", "%25"};
+    std::string pass, passEncoded;
+    for (int i = 0; i < 64; i++)
+    {
+        pass += "&=%"[i % 3];
+        passEncoded += escapes[i % 3];
+    }
+
+    const std::vector<Case> corpus = {
+        {"ssid=Home&pass=secret123", {{"ssid", "Home"}, {"pass", "secret123"}}, 0},
+        {"ssid=My+Net%21&tz=CET-1CEST%2CM3.5.0", {{"ssid", "My Net!"}, {"tz", "CET-1CEST,M3.5.0"}}, 0},
+
+        // '=' inside the value is part of it, encoded or not
+        {"pass=a=b==c", {{"pass", "a=b==c"}}, 0},
+        {"pass=a%3Db", {{"pass", "a=b"}}, 0},
+        {"pass=" + passEncoded, {{"pass", pass}}, 0},
+
+        // empty values are valid, empty keys and pairs without '=' are dropped
+        {"ip=&mask=", {{"ip", ""}, {"mask", ""}}, 0},
+        {"=value&ssid=x", {{"ssid", "x"}}, 1},
+        {"=", {}, 1},
+        {"ssid&ip=1.2.3.4", {{"ip", "1.2.3.4"}}, 1},
+        {"&&ssid=x&&", {{"ssid", "x"}}, 0},
+
+        // malformed and truncated escapes are kept verbatim
+        {"a=%zz&b=%4&c=%&d=50%", {{"a", "%zz"}, {"b", "%4"}, {"c", "%"}, {"d", "50%"}}, 0},
+        {"a=%4z%41", {{"a", "%4zA"}}, 0},
+        {"k%65y=v", {{"key", "v"}}, 0},
+
+        // limits of the fixed buffers, the limit is the encoded length
+        {key24 + "=1", {{key24, "1"}}, 0},
+        {key25 + "=1&ssid=x", {{"ssid", "x"}}, 1},
+        {"v=" + value256, {{"v", value256}}, 0},
+        {"v=" + value257 + "&ssid=x", {{"ssid", "x"}}, 1},
+        {"v=" + value257 + "=more&ssid=x", {{"ssid", "x"}}, 1},
+    };
+
+    for (const auto &c : corpus)
+    {
+        Result r = recv(c.body);
+        CHECK(r.accepted);
+        CHECK(r.pairs == c.pairs);
+        CHECK(r.errors == c.errors);
+        if (r.pairs != c.pairs || r.errors != c.errors)
+            fprintf(stderr, "  body [%.60s] %zu pairs, %d errors\n", c.body.c_str(), r.pairs.size(), r.errors);
+    }
+
+    // split inside an escape: "%" | "4" | "1", every split point of a short body
+    const std::string esc = "ssid=a%41b&pass=p%3D%26";
+    for (size_t a = 0; a <= esc.size(); a++)
+    {
+        for (size_t b = a; b <= esc.size(); b++)
+        {
+            Result r;
+            FormParser parser([&r](std::string_view key, std::string_view value)
+                              { r.pairs.emplace_back(key, value); });
+            parser.feed(esc.data(), a);
+            parser.feed(esc.data() + a, b - a);
+            parser.feed(esc.data() + b, esc.size() - b);
+            parser.finish();
+            CHECK((r.pairs == Pairs{{"ssid", "aAb"}, {"pass", "p=&"}}));
+            CHECK(parser.errors() == 0);
+        }
+    }
+
+    // random chunk splits of the whole corpus as one body give the same result as 128 B chunks
+    std::string body;
+    for (const auto &c : corpus)
+    {
+        if (body.size() + c.body.size() + 1 > FormParser::maxBody)
+            break;
+        body += c.body + "&";
+    }
+    const Result reference = recv(body);
+    CHECK(reference.accepted);
+    CHECK(reference.errors == 6);
+
+    std::mt19937 rng(2025);
+    for (int round = 0; round < 2000; round++)
+    {
+        std::uniform_int_distribution<size_t> size(1, round % 2 ? 3 : FormParser::recvChunk);
+        CHECK(parse(body, [&]
+                    { return size(rng); }) == reference);
+    }
+
+    // random bodies from the form alphabet: no crash, views within the limits
+    const char alphabet[] = "ab=&%+3D4zF";
+    for (int round = 0; round < 2000; round++)
+    {
+        std::string junk(std::uniform_int_distribution<size_t>(1, 600)(rng), 'x');
+        for (auto &ch : junk)
+            ch = alphabet[std::uniform_int_distribution<size_t>(0, sizeof(alphabet) - 2)(rng)];
+        Result r = recv(junk);
+        for (const auto &[k, v] : r.pairs)
+        {
+            CHECK(!k.empty() && k.size() <= FormParser::maxKey);
+            CHECK(v.size() <= FormParser::maxValue);
+        }
+        std::uniform_int_distribution<size_t> size(1, 7);
+        CHECK(parse(junk, [&]
+                    { return size(rng); }) == r);
+    }
+
+    // Content-Length over 4 KB or empty is rejected before receiving
+    CHECK(!recv("").accepted);
+    CHECK(recv(std::string(FormParser::maxBody, 'a')).accepted);
+    CHECK(!recv("ssid=x&" + std::string(FormParser::maxBody, 'a')).accepted);
+
+    return testResult();
+}
@@ -0,0 +1,175 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_history_export.cpp
+/// @author Petr Vanek
+///
+/// The export must stream in flat memory: the peak heap use while exporting a whole
+/// year of day files is the same as for a single day.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <map>
+#include <string>
+#include "history_export.h"
+#include "test_util.h"
+
+namespace
+{
+    // heap accounting of operator new/delete
+    size_t live = 0;
+    size_t peak = 0;
+
+    struct Card
+    {
+        std::map<std::string, std::string> files;
+        int reads = 0;
+    };
+
+    std::string dayFile(time_t day, float base)
+    {
+        std::string s;
+        char v[32];
+        for (int h = 0; h < 24; h++)
+        {
+            snprintf(v, sizeof(v), "%.1f,", base + h);
+            s += v;
+        }
+        snprintf(v, sizeof(v), "0,%lld", static_cast<long long>(day));
+        return s + v;
+    }
+
+    void addDay(Card &card, time_t day, float pv, float cons)
+    {
+        struct tm t;
+        localtime_r(&day, &t);
+        char name[16];
+        snprintf(name, sizeof(name), "/%02d%02d", t.tm_mday, t.tm_mon + 1);
+        card.files[std::string(name) + ".pv"] = dayFile(day, pv);
+        card.files[name] = dayFile(day, cons);
+    }
+
+    struct Result
+    {
+        esp_err_t rc;
+        size_t bytes;
+        int lines;
+        size_t peak;
+        std::string head;
+    };
+
+    Result exportRange(Card &card, const char *query)
+    {
+        Result r{ESP_OK, 0, 0, 0, {}};
+        r.head.reserve(4096);
+
+        httpd_req_t req;
+        req.query = query;
+        req.sink = [&r](const char *data, size_t len)
+        {
+            r.bytes += len;
+            for (size_t i = 0; i < len; i++)
+                r.lines += data[i] == '\n';
+            size_t room = r.head.capacity() - r.head.size();
+            r.head.append(data, std::min(room, len));
+            return true;
+        };
+
+        HistoryExport exp(&req, [&card](const std::string &path, std::string &content)
+                          {
+            card.reads++;
+            auto it = card.files.find(path);
+            if (it == card.files.end())
+                return false;
+            content = it->second;
+            return true; });
+
+        size_t base = live;
+        peak = live;
+        r.rc = exp.run();
+        r.peak = peak - base;
+        CHECK(req.finished);
+        return r;
+    }
+
+    std::string date(time_t t)
+    {
+        char buf[11];
+        struct tm tmDay;
+        localtime_r(&t, &tmDay);
+        strftime(buf, sizeof(buf), "%Y-%m-%d", &tmDay);
+        return buf;
+    }
+}
+
+void *operator new(size_t size)
+{
+    auto *p = static_cast<size_t *>(malloc(size + sizeof(size_t)));
+    if (!p)
+        throw std::bad_alloc();
+    *p = size;
+    live += size;
+    peak = std::max(peak, live);
+    return p + 1;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (!ptr)
+        return;
+    auto *p = static_cast<size_t *>(ptr) - 1;
+    live -= *p;
+    free(p);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+int main()
+{
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    time_t now = time(NULL);
+    time_t today = now - now % 86400 + 12 * 3600;
+
+    // one file per calendar day, the card holds the last 365 days
+    Card card;
+    for (int d = 0; d < 365; d++)
+        addDay(card, today - d * 86400, 100.0f, 200.0f);
+
+    std::string q1 = "from=" + date(today) + "&to=" + date(today);
+    auto one = exportRange(card, q1.c_str());
+    CHECK(one.rc == ESP_OK);
+    CHECK(one.lines == 1 + 24);
+    CHECK(one.head.find(date(today) + ",0,100.0,200.0\n") != std::string::npos);
+    CHECK(one.head.find(date(today) + ",23,123.0,223.0\n") != std::string::npos);
+
+    std::string qy = "from=" + date(today - 364 * 86400) + "&to=" + date(today);
+    auto year = exportRange(card, qy.c_str());
+    CHECK(year.rc == ESP_OK);
+    CHECK(year.lines == 1 + 365 * 24);
+    CHECK(year.bytes > 100 * 1024);
+
+    std::string qj = qy + "&format=json";
+    auto json = exportRange(card, qj.c_str());
+    CHECK(json.rc == ESP_OK);
+    CHECK(json.head.rfind("[{\"date\":", 0) == 0);
+
+    // flat memory - the range does not change the peak
+    printf("peak heap: 1 day %zu B, 365 days %zu B, json %zu B, %zu B streamed\n", one.peak, year.peak, json.peak, year.bytes);
+    CHECK(year.peak <= one.peak);
+    CHECK(json.peak <= one.peak);
+
+    // a file of the same day in the previous year is skipped
+    Card stale;
+    addDay(stale, today - 366 * 86400, 1.0f, 1.0f);
+    auto old = exportRange(stale, ("from=" + date(today - 86400) + "&to=" + date(today - 86400)).c_str());
+    CHECK(old.lines == 1);
+
+    return testResult();
+}
@@ -0,0 +1,126 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_key_val.cpp
+/// @author Petr Vanek
+///
+/// KeyVal::Transaction against the in-memory NVS stub: unchanged values are not
+/// written, a commit with changes calls nvs_commit exactly once, failures are reported.
+
+#include <stdio.h>
+#include <string>
+#include "key_val.h"
+#include "test_util.h"
+
+namespace
+{
+    struct Calls
+    {
+        int sets;
+        int commits;
+    };
+
+    /// @brief NVS calls made by fn
+    template <typename F>
+    Calls count(F &&fn)
+    {
+        int sets = hostNvs.sets;
+        int commits = hostNvs.commits;
+        fn();
+        return Calls{hostNvs.sets - sets, hostNvs.commits - commits};
+    }
+
+    bool save(const std::string &ssid, const std::string &pass, uint32_t ckpt, uint32_t pubint, int *changed = nullptr)
+    {
+        auto tx = KeyVal::getInstance().begin();
+        tx.writeString("ssid", ssid);
+        tx.writeString("passwd", pass);
+        tx.writeUint32("ckpt", ckpt);
+        tx.writeUint32("pubint", pubint);
+        bool rc = tx.commit();
+        if (changed)
+            *changed = tx.changed();
+        return rc;
+    }
+}
+
+int main()
+{
+    KeyVal &kv = KeyVal::getInstance();
+    CHECK(kv.init("test", true));
+
+    // first save - everything is new, one commit
+    int changed = -1;
+    bool ok = false;
+    auto c = count([&]
+                   { ok = save("Home", "", 15, 60, &changed); });
+    CHECK(ok);
+    CHECK(changed == 4);
+    CHECK(c.sets == 4 && c.commits == 1);
+    CHECK(kv.readString("ssid") == "Home");
+    CHECK(kv.readUint32("ckpt") == 15);
+
+    // the same form again - no write, no commit
+    c = count([&]
+              { ok = save("Home", "", 15, 60, &changed); });
+    CHECK(ok);
+    CHECK(changed == 0);
+    CHECK(c.sets == 0 && c.commits == 0);
+
+    // one string and one number changed - two writes, one commit
+    c = count([&]
+              { ok = save("Home", "secret123", 15, 30, &changed); });
+    CHECK(ok);
+    CHECK(changed == 2);
+    CHECK(c.sets == 2 && c.commits == 1);
+    CHECK(kv.readString("passwd") == "secret123");
+    CHECK(kv.readUint32("pubint") == 30);
+
+    // a prefix or an extension of the stored string is a change
+    c = count([&]
+              { ok = save("Hom", "secret123", 15, 30); });
+    CHECK(c.sets == 1 && c.commits == 1);
+    c = count([&]
+              { ok = save("Home2", "secret123", 15, 30); });
+    CHECK(c.sets == 1 && c.commits == 1);
+    CHECK(kv.readString("ssid") == "Home2");
+
+    // staged values are discarded by the commit
+    auto tx = kv.begin();
+    tx.writeUint32("ckpt", 99);
+    CHECK(tx.commit());
+    c = count([&]
+              { CHECK(tx.commit()); });
+    CHECK(c.sets == 0 && c.commits == 0);
+    CHECK(kv.readUint32("ckpt") == 99);
+
+    // failed nvs_commit is reported
+    hostNvs.commitError = ESP_FAIL;
+    c = count([&]
+              { ok = save("Office", "secret123", 99, 30); });
+    CHECK(!ok);
+    CHECK(c.sets == 1 && c.commits == 1);
+    hostNvs.commitError = ESP_OK;
+
+    // failed write stops the transaction, the values written before it are committed once
+    hostNvs.failSetAt = hostNvs.sets + 1;
+    hostNvs.setError = ESP_ERR_NVS_NO_FREE_PAGES;
+    c = count([&]
+              { ok = save("Cafe", "password1", 1, 10, &changed); });
+    CHECK(!ok);
+    CHECK(changed == 1);
+    CHECK(c.sets == 2 && c.commits == 1);
+    CHECK(kv.readString("ssid") == "Cafe");
+    CHECK(kv.readString("passwd") == "secret123");
+    hostNvs.failSetAt = -1;
+
+    // nothing changed and nothing to commit is a success
+    c = count([&]
+              { ok = kv.begin().commit(); });
+    CHECK(ok);
+    CHECK(c.sets == 0 && c.commits == 0);
+
+    kv.done();
+    return testResult();
+}
@@ -0,0 +1,116 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_mqtt_routes.cpp
+/// @author Petr Vanek
+///
+/// Routing under concurrent subscribe / unsubscribe: the event task dispatches messages
+/// while holding the esp-mqtt API lock, message callbacks subscribe and unsubscribe on
+/// the event task and the application task changes the subscriptions at the same time.
+/// Nothing may deadlock and a permanent subscription must receive every message.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "mqtt.h"
+#include "test_util.h"
+
+namespace
+{
+    constexpr int messages = 20000;
+    constexpr int appRounds = 5000;
+
+    std::atomic<int> permanent{0};
+    std::atomic<int> dynamic{0};
+    std::atomic<int> reentrant{0};
+
+    void deliver(const char *topic, const char *payload)
+    {
+        std::string t(topic), p(payload);
+        esp_mqtt_event_t event{};
+        event.event_id = MQTT_EVENT_DATA;
+        event.topic = t.data();
+        event.topic_len = static_cast<int>(t.size());
+        event.data = p.data();
+        event.data_len = event.total_data_len = static_cast<int>(p.size());
+        esp_mqtt_client_dispatch(hostMqttClient, event);
+    }
+
+    void connect()
+    {
+        esp_mqtt_event_t event{};
+        event.event_id = MQTT_EVENT_CONNECTED;
+        esp_mqtt_client_dispatch(hostMqttClient, event);
+    }
+}
+
+int main()
+{
+    std::atomic<bool> done{false};
+
+    // a deadlocked thread cannot be joined, the watchdog ends the test
+    std::thread watchdog([&done]
+                         {
+        for (int i = 0; i < 300 && !done; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (!done)
+        {
+            fprintf(stderr, "deadlock: routing did not finish in 30 s\n");
+            _exit(1);
+        } });
+
+    {
+        Mqtt mqtt;
+        CHECK(mqtt.init("mqtt://host.test"));
+        CHECK(mqtt.subscribe("pv/+/power", [](std::string_view, std::string_view message)
+                             { permanent += message == "42"; }));
+        connect();
+        CHECK(mqtt.isConnected());
+
+        // callback on the event task changes the subscriptions while its own trie is in use
+        CHECK(mqtt.subscribe("cmd/#", [&mqtt](std::string_view topic, std::string_view)
+                             {
+            reentrant++;
+            if (topic == "cmd/add")
+                mqtt.subscribe("tmp/+", [](std::string_view, std::string_view) {});
+            else
+                mqtt.unsubscribe("tmp/+"); }));
+
+        std::thread eventTask([]
+                              {
+            for (int i = 0; i < messages; i++)
+            {
+                deliver("pv/inverter/power", "42");
+                deliver(i % 2 ? "cmd/add" : "cmd/remove", "");
+                deliver("dyn/value", "1");
+            } });
+
+        std::thread appTask([&mqtt]
+                            {
+            for (int i = 0; i < appRounds; i++)
+            {
+                mqtt.subscribe("dyn/#", [](std::string_view, std::string_view)
+                               { dynamic++; });
+                if (i % 16 == 0)
+                    mqtt.resubscribe();
+                mqtt.unsubscribe("dyn/#");
+            } });
+
+        eventTask.join();
+        appTask.join();
+    }
+
+    done = true;
+    watchdog.join();
+
+    printf("permanent %d, re-entrant %d, dynamic %d messages\n", permanent.load(), reentrant.load(), dynamic.load());
+    CHECK(permanent == messages);
+    CHECK(reentrant == messages);
+    CHECK(dynamic <= messages);
+
+    return testResult();
+}
@@ -0,0 +1,102 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_url_decode.cpp
+/// @author Petr Vanek
+///
+/// Utils::urlDecodeInPlace - malformed escapes, '+', and a printed benchmark against the
+/// previous ostringstream/std::stoi decoder.
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include "utils.h"
+#include "test_util.h"
+
+namespace
+{
+    std::string decode(std::string s)
+    {
+        s.resize(Utils::urlDecodeInPlace(s.data(), s.size()));
+        return s;
+    }
+
+    // previous implementation, reference of the behavior and the benchmark baseline
+    std::string decodeStream(std::string_view encoded)
+    {
+        std::ostringstream decoded;
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            if (encoded[i] == '%' && i + 2 < encoded.size() && std::isxdigit(encoded[i + 1]) && std::isxdigit(encoded[i + 2]))
+            {
+                std::string hexValue(encoded.substr(i + 1, 2));
+                decoded << static_cast<char>(std::stoi(hexValue, nullptr, 16));
+                i += 2;
+            }
+            else if (encoded[i] == '+')
+                decoded << ' ';
+            else
+                decoded << encoded[i];
+        }
+        return decoded.str();
+    }
+
+    template <typename F>
+    double nsPerByte(const std::string &input, int rounds, F &&fn)
+    {
+        size_t sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++)
+            sink += fn(input);
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (sink == 0)
+            printf("-");
+        return ns / (double(input.size()) * rounds);
+    }
+}
+
+int main()
+{
+    // valid escapes and '+'
+    CHECK(decode("%41") == "A");
+    CHECK(decode("a%41b") == "aAb");
+    CHECK(decode("+") == " ");
+    CHECK(decode("a+b+%2B") == "a b +");
+    CHECK(decode("%e2%82%AC") == "\xe2\x82\xac");
+    CHECK(decode("%00x") == std::string("\0x", 2));
+    CHECK(decode("") == "");
+
+    // malformed escapes are kept verbatim
+    CHECK(decode("%") == "%");
+    CHECK(decode("%4") == "%4");
+    CHECK(decode("%zz") == "%zz");
+    CHECK(decode("%4z") == "%4z");
+    CHECK(decode("ab%") == "ab%");
+    CHECK(decode("%%41") == "%A");
+
+    // same result as the previous decoder
+    const char *cases[] = {"%", "%4", "%zz", "+", "%41", "x%2", "%%%", "a%20b%2", "%g1%1g", "pass%3D%26%2B+x"};
+    for (const char *c : cases)
+        CHECK(decode(c) == decodeStream(c));
+
+    CHECK(Utils::urlDecode("ssid=My+Net%21") == "ssid=My Net!");
+
+    // benchmark - a typical settings form
+    std::string form;
+    while (form.size() < 4096)
+        form += "ssid=My+Home+Net&pass=p%40ss%21w%3Drd&mqtt=192.168.1.20&topic=solax%2Fdata&timezone=CET-1CEST%2CM3.5.0%2CM10.5.0%2F3&";
+
+    const int rounds = 200;
+    double inPlace = nsPerByte(form, rounds, [](const std::string &in)
+                               { std::string s(in); return Utils::urlDecodeInPlace(s.data(), s.size()); });
+    double stream = nsPerByte(form, rounds, [](const std::string &in)
+                              { return decodeStream(in).size(); });
+    // timing is only reported, a loaded machine must not fail the test
+    printf("urlDecode %zu B: in place %.2f ns/B, ostringstream %.2f ns/B (%.1fx)\n", form.size(), inPlace, stream, stream / inPlace);
+
+    // both decoders agree on the benchmark input
+    CHECK(decode(form) == decodeStream(form));
+
+    return testResult();
+}
@@ -0,0 +1,30 @@
+//
+// vim: ts=4 et
+// Copyright (c) 2025 Petr Vanek, petr@fotoventus.cz
+//
+/// @file   test_util.h  Minimal checks of the host tests
+/// @author Petr Vanek
+
+#pragma once
+
+#include <stdio.h>
+
+inline int testFailures = 0;
+
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            testFailures++;                                                      \
+        }                                                                        \
+    } while (0)
+
+/// @brief Exit code of the test
+inline int testResult()
+{
+    if (testFailures)
+        fprintf(stderr, "%d check(s) failed\n", testFailures);
+    return testFailures ? 1 : 0;
+}